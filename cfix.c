@@ -27,56 +27,260 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef CFIX_KEY64
+#include "cfix64.h"
+#else
 #include "cfix.h"
+#endif
 #include "hash_primes.h"
 
+/*
+ * Key/word type parameterization - this file compiles twice: once as shipped
+ * for 32-bit keys, and once more from cfix64.c with CFIX_KEY64 defined, which
+ * widens every key and data word to 64 bits, halves the number of entries per
+ * 64-byte bin and maps all external names onto the cfix64 prefix.  Everything
+ * below is written against cfix_uint_t and the shared macros, so both
+ * variants come out of the same source.
+ */
+#ifdef CFIX_KEY64
+typedef uint64_t cfix_uint_t;
+
+#undef CFIX_KEY_SIZE
+#define CFIX_KEY_SIZE CFIX64_KEY_SIZE
+
+#define cfix cfix64
+#define cfix_t cfix64_t
+#define cfix_iter cfix64_iter
+#define cfix_iter_t cfix64_iter_t
+#define cfix_ticket cfix64_ticket
+#define cfix_ticket_t cfix64_ticket_t
+#define cfix_stats cfix64_stats
+#define cfix_stats_t cfix64_stats_t
+#define cfix_create cfix64_create
+#define cfix_destroy cfix64_destroy
+#define cfix_clone cfix64_clone
+#define cfix_snapshot cfix64_snapshot
+#define cfix_insert cfix64_insert
+#define cfix_insert_bulk cfix64_insert_bulk
+#define cfix_merge cfix64_merge
+#define cfix_reserve cfix64_reserve
+#define cfix_delete cfix64_delete
+#define cfix_lookup cfix64_lookup
+#define cfix_lookup_seq cfix64_lookup_seq
+#define cfix_lookup_batch cfix64_lookup_batch
+#define cfix_lookup_prepare cfix64_lookup_prepare
+#define cfix_lookup_finish cfix64_lookup_finish
+#define cfix_update cfix64_update
+#define cfix_min cfix64_min
+#define cfix_max cfix64_max
+#define cfix_keys cfix64_keys
+#define cfix_bins cfix64_bins
+#define cfix_migrate cfix64_migrate
+#define cfix_maintain cfix64_maintain
+#define cfix_reclaim cfix64_reclaim
+#define cfix_rebuild cfix64_rebuild
+#define cfix_rebuild_par cfix64_rebuild_par
+#define cfix_freeze cfix64_freeze
+#define cfix_frozen cfix64_frozen
+#define cfix_apply cfix64_apply
+#define cfix_apply_par cfix64_apply_par
+#define cfix_save cfix64_save
+#define cfix_load cfix64_load
+#define cfix_iter_create cfix64_iter_create
+#define cfix_iter_destroy cfix64_iter_destroy
+#define cfix_iter_reset cfix64_iter_reset
+#define cfix_iter_current cfix64_iter_current
+#define cfix_iter_forward cfix64_iter_forward
+
+/* The two variants keep separate m2 handles (and reports) per id. */
+#define CFIX_M2(id) "cfix64" id
+#else
+typedef uint32_t cfix_uint_t;
+
+#define CFIX_M2(id) "cfix" id
+#endif
+
 //#define CFIX_CHECK
 
 //#define CFIX_VERBOSE
 
+/*
+ * Single-writer / multi-reader mode - mutators keep the version counter odd
+ * while the table is inconsistent and readers use cfix_lookup_seq to retry
+ * torn probes.  Replaced bin arrays are parked on a retired list instead of
+ * being recycled immediately (see cfix_reclaim).
+ */
+//#define CFIX_SEQLOCK
+
+#ifdef CFIX_SEQLOCK
+#define CFIX_RETIRED 64
+#endif
+
 
 #define CFIX_INFDATA
 
-#define CFIX_BIN_LOCATE_BINARY
+/*
+ * Per-bin filter - each bin gets a 16-bit Bloom word consulted before the
+ * bin itself, so probes for absent keys are rejected with a single narrow
+ * load instead of one or two full cache-line searches.  Costs two bytes per
+ * bin and a filter rebuild (one bin scan) per deletion.
+ */
+#define CFIX_FILTER
+
+/*
+ * Cuckoo insertion by breadth-first path search - instead of recursive
+ * depth-first eviction with undo-on-failure, search for a shortest chain of
+ * hops ending in a bin with a free slot (touching only keys) and perform the
+ * few moves along that chain once a path is found.  Shorter chains, bounded
+ * worst-case insert latency and higher reachable fill before growth.
+ */
+#define CFIX_CUCKOO_BFS
+
+#ifdef CFIX_CUCKOO_BFS
+#define CFIX_BFS_NODES 512
+#endif
+
+/*
+ * Number of old bins consumed by a resize or rebuild before the physical
+ * pages behind them are released with madvise(MADV_DONTNEED), so peak RSS
+ * stays near one table instead of old plus new.
+ */
+#define CFIX_RELEASE_CHUNK 4096
+
+/** @brief Maximum number of threads cfix_apply_par will spread a scan over. */
+#define CFIX_APPLY_PAR_MAX 64
+
+/** @brief Maximum number of workers cfix_rebuild_par will rehash with. */
+#define CFIX_REBUILD_PAR_MAX 64
+
+/*
+ * Bin search method - SIMD compares the whole bin (one cache line) in one or
+ * two vector operations and is selected automatically when the compiler
+ * targets AVX2 or better, otherwise the branch-free binary search is used.
+ */
+#if defined(__AVX512F__) || defined(__AVX2__)
+#	define CFIX_BIN_LOCATE_SIMD
+#	include <immintrin.h>
+#else
+#	define CFIX_BIN_LOCATE_BINARY
+#endif
 
 #define CFIX_TTL(h) ((h)->depth < (h)->bins ? (h)->depth : (h)->bins) 
 
-#define CFIX_INF ((uint32_t)0xffffffff)
+#define CFIX_INF ((cfix_uint_t)~(cfix_uint_t)0)
 
 #define CFIX_KEY(h, base, offset) ((h)->bin[(base) * (h)->size][offset])
 
 #define CFIX_DATA(h, base, offset) (&((h)->bin[(base) * (h)->size + 1][(offset) * ((h)->size - 1)]))
 
+/** @brief Payload record of a slab handle in indirect mode - the data word of an entry then holds a record index instead of the payload itself. */
+#define CFIX_SLAB(h, idx) (&(h)->slab[(size_t)(idx) * (h)->data])
+
+/** @brief Free record list terminator. */
+#define CFIX_SLAB_NIL ((uint32_t)0xffffffff)
+
 #define CFIX_NODATA 0xdeadbabe
 
+#define CFIX_MOD(h, x) hash_primes_mod((h)->magic, (h)->bins, (x))
+
+/** @brief Snapshot file magic - with the key width in the second byte and the format version in the low byte - the two variants never cross-load. */
+#ifdef CFIX_KEY64
+#define CFIX_FILE_MAGIC ((uint64_t)0xcf1c5a9000004004)
+#else
+#define CFIX_FILE_MAGIC ((uint64_t)0xcf1c5a9000000004)
+#endif
+
+/** @brief Offset of the bin array in a snapshot file - page aligned so the mmap'ed array keeps bin alignment. */
+#define CFIX_FILE_BINOFF ((size_t)4096)
+
 static m2_t *cfix_handle = NULL,
 			*cfix_bin_handle = NULL,
-			*cfix_iter_handle = NULL;
+			*cfix_iter_handle = NULL,
+			*cfix_bulk_handle = NULL,
+			*cfix_filter_handle = NULL,
+			*cfix_cow_handle = NULL,
+			*cfix_slab_handle = NULL;
 
-typedef uint32_t cfix_bin_t[CFIX_BIN_SIZE];
+static pthread_once_t cfix_handle_once = PTHREAD_ONCE_INIT;
+
+typedef cfix_uint_t cfix_bin_t[CFIX_BIN_SIZE];
 
 static void cfix_data_clear(cfix_t *h, uint32_t base, uint32_t offset);
+static void cfix_migrate_finish(cfix_t *h);
+static void cfix_rebuild_to(cfix_t *h, uint32_t keys);
 
 struct cfix {
 	cfix_bin_t *bin;	/*< Array of bins corresponding to a cache lines. */
 #ifdef CFIX_INFDATA
-	uint32_t *infdata;	/*< Data associated with infinity, i.e. 0xffffffff. */
+	cfix_uint_t *infdata;	/*< Data associated with infinity, i.e. the all-ones key. */
 #endif
 	uint64_t version;	/*< Running version number which is increased by one on each update operation. */
 	uint32_t prix;		/*< Current prime index. */
 	uint32_t bins;		/*< Current number of bins. */
+	uint64_t magic;		/*< Reciprocal of the current number of bins - turns the hash modulo into a multiplication (see hash_primes_mod). */
 	uint32_t keys;		/*< Current number of keys. */
 	uint32_t size;		/*< Size each entry measured in number of uint32_t's. */
+	uint32_t data;		/*< Data words per entry as configured - equals size - 1 except in indirect mode where size is fixed at 2. */
+	uint32_t indirect;	/*< Non-zero selects out-of-line data - the data word of an entry holds a slab record index. */
+	cfix_uint_t *slab;	/*< Payload record slab in indirect mode or NULL. */
+	uint32_t slab_cap;	/*< Capacity of the slab in records. */
+	uint32_t slab_free;	/*< Head of the free record list threaded through the slab or CFIX_SLAB_NIL. */
 	uint32_t depth;		/*< Maximum recursive depth for cuckoo insertion - higher number yields more expensive insertion and higher fill factor. */
-	uint32_t min;		/*< Smallest key present in the hash table. */
-	uint32_t max;		/*< Largest key present in the hash table. */
+	cfix_uint_t min;	/*< Smallest key present in the hash table. */
+	cfix_uint_t max;	/*< Largest key present in the hash table. */
 	double lower;		/*< Lower fill threshold 0.0 - 1.0 but smaller than upper threshold. When fill ratio go below threshold after deletion the table is shrunk by reducing number of bins. */
 	double upper;		/*< Upper fill threshold 0.0 - 1.0 but larger than upper threshold. When fill ratio will exceed threshold after insertion the table is grown before insertion. */  
 	double growth;		/*< Base growth factor for increasing primes index and number of bins when insertion fails - controls level of growth in bin increase. */
 	double attempt;		/*< Attempt factor when increasing prime index when bin increase fails - controls level of increase for next attempt when bin increase fails. */
 	double random;		/*< Random factor used to compute prime index and bin increase - controls level of randomness in bin increase. */
+	uint16_t *filter;	/*< Per-bin filter words or NULL when CFIX_FILTER is disabled. */
+	uint16_t *mig_filter;	/*< Filter words of the old array during incremental resize. */
+	cfix_bin_t *mig_bin;	/*< Old bin array during incremental resize or NULL when no migration is in progress. */
+	uint32_t mig_bins;	/*< Number of bins in the old array. */
+	uint64_t mig_magic;	/*< Reciprocal of the number of bins in the old array. */
+	uint32_t mig_next;	/*< Next old bin to migrate - bins below this index are empty. */
+	uint32_t mig_freed;	/*< Old bins below this index have had their pages released. */
+	uint32_t mig_keys;	/*< Number of keys remaining in the old array. */
+	uint32_t migrate;	/*< Number of old bins migrated per update operation - zero selects stop-the-world rehash. */
+	bool shrink;		/*< Deferred shrink pending - set by cfix_delete, consumed by cfix_maintain. */
+	bool frozen;		/*< Read-only - set by cfix_freeze, mutators assert against it. */
+	uint32_t ptwo;		/*< Non-zero selects power-of-two bin counts - prix is then the log2 of the bin count. */
+	void *map;			/*< Snapshot mapping when the bin array was adopted from cfix_load or NULL. */
+	size_t maplen;		/*< Length of the snapshot mapping. */
+	struct cfix_cow *cow;	/*< Descriptor of the shared bin array when clones or snapshots reference it, NULL when exclusively owned. */
+	struct {
+		uint64_t locate_primary;	/*< Successful probes resolved in the primary bin. */
+		uint64_t locate_secondary;	/*< Successful probes resolved in the secondary bin. */
+		uint64_t displaced;			/*< Entries displaced on successful cuckoo paths - used to derive chain lengths. */
+		uint64_t chain[CFIX_CHAIN_HIST];	/*< Histogram of cuckoo relocation chain lengths over successful insertions. */
+		uint64_t grows;				/*< Number of growth events. */
+		uint64_t shrinks;			/*< Number of shrink events. */
+		uint64_t rebuilds;			/*< Number of rebuilds. */
+		uint64_t moved;				/*< Keys reinserted by resize events. */
+		uint64_t retries;			/*< Scrapped arrays in resize retry loops. */
+		uint32_t hist[CFIX_BIN_SIZE + 1];	/*< Occupancy histogram of the current bin array - maintained incrementally. */
+		uint32_t primary;			/*< Keys stored in their primary bin - maintained incrementally. */
+	} count;			/*< Always-on operation counters reported by cfix_stats. */
 #ifdef CFIX_INFDATA
-	uint32_t _infdata[CFIX_DATA_MAXSIZE];	/*< Storage location for data associated with infinity, i.e. 0xffffffff. */
+	cfix_uint_t _infdata[CFIX_DATA_MAXSIZE];	/*< Storage location for data associated with infinity, i.e. the all-ones key. */
+#endif
+#ifdef CFIX_SEQLOCK
+	struct {
+		cfix_bin_t *bin;	/*< Replaced bin array awaiting reclamation or NULL for a replaced slab. */
+		size_t size;		/*< Allocation size of the array. */
+		uint16_t *filter;	/*< Filter words of the array or NULL. */
+		size_t fbins;		/*< Number of filter words. */
+		cfix_uint_t *slab;	/*< Replaced payload slab awaiting reclamation or NULL. */
+		size_t slabw;		/*< Allocation size of the slab in words. */
+		void *map;			/*< Snapshot mapping backing the array or NULL. */
+		size_t maplen;		/*< Length of the snapshot mapping. */
+	} retired[CFIX_RETIRED];	/*< Replaced bin arrays awaiting reclamation. */
+	uint32_t retired_count;		/*< Number of retired arrays. */
 #endif
 };
 
@@ -88,6 +292,20 @@ struct cfix_iter {
 	uint32_t offset;	/*< Current offset. */
 };
 
+/** @brief Descriptor of a bin array shared copy-on-write between a table and its clones/snapshots. */
+struct cfix_cow {
+	uint32_t refs;		/*< Number of handles referencing the array. */
+	cfix_bin_t *bin;	/*< The shared bin array. */
+	size_t n;			/*< Allocation size of the array in cfix_bin_t's. */
+	uint16_t *filter;	/*< Filter words of the array or NULL. */
+	size_t fbins;		/*< Number of filter words. */
+	cfix_uint_t *slab;	/*< Payload slab shared along with the array in indirect mode or NULL. */
+	size_t slabw;		/*< Allocation size of the slab in words. */
+	void *map;			/*< Snapshot-file mapping backing the array or NULL. */
+	size_t maplen;		/*< Length of the snapshot-file mapping. */
+};
+
+#ifndef CFIX_KEY64
 /*****************************************************************************
  * Hash functions from http://burtleburtle.net/bob/hash/integer.html         *
  * Author: Bob Jenkins                                                       *
@@ -116,14 +334,70 @@ cfix_half_avalanche(uint32_t a)
 	return a;
 }
 /*****************************************************************************/
+#else
+/*****************************************************************************
+ * 64-to-32-bit mixers filling the same roles - Thomas Wang's 64-bit hash    *
+ * and a murmur-style finalizer with a leading complement so the two stay    *
+ * independent on the same key, like the pair above.                         *
+ *****************************************************************************/
+	static uint32_t
+cfix_full_avalanche(uint64_t a)
+{
+	a = (~a) + (a << 18);
+	a = a ^ (a >> 31);
+	a = a * 21;
+	a = a ^ (a >> 11);
+	a = a + (a << 6);
+	a = a ^ (a >> 22);
+	return (uint32_t)a;
+}
+
+	static uint32_t
+cfix_half_avalanche(uint64_t a)
+{
+	a = ~a;
+	a ^= a >> 33;
+	a *= (uint64_t)0xff51afd7ed558ccd;
+	a ^= a >> 33;
+	a *= (uint64_t)0xc4ceb9fe1a85ec53;
+	a ^= a >> 33;
+	return (uint32_t)a;
+}
+/*****************************************************************************/
+#endif
+
+/*
+ * Create all m2 handles up front under pthread_once - lazy creation at each
+ * first use raced when several threads created or grew instances at once.
+ */
+	static void
+cfix_handle_init(void)
+{
+	cfix_handle = m2_create(CFIX_M2("_t"), sizeof(cfix_t));
+	assert(cfix_handle != NULL);
+	cfix_bin_handle = m2_create(CFIX_M2("_bin_t"), sizeof(cfix_bin_t));
+	assert(cfix_bin_handle != NULL);
+	/* Bin arrays grow to gigabytes probed at random - back them with
+	 * huge pages to keep lookups from thrashing the dTLB. */
+	m2_huge(cfix_bin_handle, true);
+	cfix_iter_handle = m2_create(CFIX_M2("_iter_t"), sizeof(cfix_iter_t));
+	assert(cfix_iter_handle != NULL);
+	cfix_bulk_handle = m2_create(CFIX_M2("_bulk"), sizeof(uint64_t));
+	assert(cfix_bulk_handle != NULL);
+#ifdef CFIX_FILTER
+	cfix_filter_handle = m2_create(CFIX_M2("_filter"), sizeof(uint16_t));
+	assert(cfix_filter_handle != NULL);
+#endif
+	cfix_cow_handle = m2_create(CFIX_M2("_cow"), sizeof(struct cfix_cow));
+	assert(cfix_cow_handle != NULL);
+	cfix_slab_handle = m2_create(CFIX_M2("_slab"), sizeof(cfix_uint_t));
+	assert(cfix_slab_handle != NULL);
+}
 
 	static cfix_t *
 cfix_reuse(void)
 {
-	if (cfix_handle == NULL) {
-		cfix_handle = m2_create("cfix_t", sizeof(cfix_t));
-		assert(cfix_handle != NULL);
-	}
+	pthread_once(&cfix_handle_once, cfix_handle_init);
 	return (cfix_t *)m2_reuse(cfix_handle, 1, true);
 }
 
@@ -136,10 +410,7 @@ cfix_recycle(cfix_t *k)
 	static cfix_bin_t *
 cfix_bin_reuse(size_t n)
 {
-	if (cfix_bin_handle == NULL) {
-		cfix_bin_handle = m2_create("cfix_bin_t", sizeof(cfix_bin_t));
-		assert(cfix_bin_handle != NULL);
-	}
+	pthread_once(&cfix_handle_once, cfix_handle_init);
 	return (cfix_bin_t *)m2_reuse(cfix_bin_handle, n, false);
 }
 
@@ -149,12 +420,318 @@ cfix_bin_recycle(cfix_bin_t *bin, size_t n)
 	m2_recycle(cfix_bin_handle, bin, n);
 }
 
+#ifdef CFIX_FILTER
+	static uint16_t *
+cfix_filter_reuse(size_t n)
+{
+	pthread_once(&cfix_handle_once, cfix_handle_init);
+	return (uint16_t *)m2_reuse(cfix_filter_handle, n, true);
+}
+#endif
+
+	static void
+cfix_filter_recycle(uint16_t *filter, size_t n)
+{
+	m2_recycle(cfix_filter_handle, (void *)filter, n);
+}
+
+	static cfix_uint_t *
+cfix_slab_reuse(size_t words)
+{
+	pthread_once(&cfix_handle_once, cfix_handle_init);
+	return (cfix_uint_t *)m2_reuse(cfix_slab_handle, words, false);
+}
+
+	static void
+cfix_slab_recycle(cfix_uint_t *slab, size_t words)
+{
+	m2_recycle(cfix_slab_handle, (void *)slab, words);
+}
+
+#ifdef CFIX_FILTER
+/*
+ * Recompute the filter word of a bin from its keys - used after deletion,
+ * the one operation that would otherwise leave stale bits set.
+ */
+	static void
+cfix_filter_rebuild(cfix_t *h, uint32_t base)
+{
+	cfix_uint_t k;
+	uint32_t o;
+	uint16_t word = 0;
+
+	for (o = 0; o < CFIX_BIN_SIZE; o++) {
+		k = CFIX_KEY(h, base, o);
+		if (k == CFIX_INF) break;
+		word |= (uint16_t)1 << (cfix_full_avalanche(k) & 0xf);
+	}
+	h->filter[base] = word;
+}
+#endif
+
+/*
+ * Share the current bin array between h and one more handle - the read half
+ * of the copy-on-write protocol used by cfix_clone and cfix_snapshot.  The
+ * descriptor takes over ownership of the array (including any snapshot-file
+ * mapping backing it) until the last reference is dropped.
+ */
+	static void
+cfix_cow_share(cfix_t *h)
+{
+	if (h->cow == NULL) {
+		struct cfix_cow *cow;
+
+		pthread_once(&cfix_handle_once, cfix_handle_init);
+		cow = (struct cfix_cow *)m2_reuse(cfix_cow_handle, 1, false);
+		cow->refs = 1;
+		cow->bin = h->bin;
+		cow->n = (size_t)h->bins * h->size;
+#ifdef CFIX_FILTER
+		cow->filter = h->filter;
+#else
+		cow->filter = NULL;
+#endif
+		cow->fbins = h->bins;
+		cow->slab = h->slab;
+		cow->slabw = (size_t)h->slab_cap * h->data;
+		cow->map = h->map;
+		cow->maplen = h->maplen;
+		h->map = NULL;
+		h->maplen = 0;
+		h->cow = cow;
+	}
+	++h->cow->refs;
+}
+
+/*
+ * Drop one reference to a shared bin array, releasing the array with the
+ * last one.
+ */
+	static void
+cfix_cow_unref(struct cfix_cow *cow)
+{
+	if (--cow->refs > 0) return;
+	if (cow->map != NULL) {
+		munmap(cow->map, cow->maplen);
+	} else {
+		cfix_bin_recycle(cow->bin, cow->n);
+	}
+	if (cow->filter != NULL) cfix_filter_recycle(cow->filter, cow->fbins);
+	if (cow->slab != NULL) cfix_slab_recycle(cow->slab, cow->slabw);
+	m2_recycle(cfix_cow_handle, (void *)cow, 1);
+}
+
+/*
+ * Ensure h exclusively owns its bin array - the write half of the
+ * copy-on-write protocol, invoked by cfix_write_begin so every mutation path
+ * is covered.  As the last remaining holder h reclaims the array outright,
+ * otherwise it detaches with a private copy and leaves the shared array to
+ * the surviving clones and snapshots.
+ */
+	static void
+cfix_cow_break(cfix_t *h)
+{
+	struct cfix_cow *cow = h->cow;
+	cfix_bin_t *bin;
+
+	h->cow = NULL;
+	if (cow->refs == 1) {
+		h->map = cow->map;
+		h->maplen = cow->maplen;
+		m2_recycle(cfix_cow_handle, (void *)cow, 1);
+		return;
+	}
+	bin = cfix_bin_reuse((size_t)h->bins * h->size);
+	memcpy(bin, h->bin, (size_t)h->bins * h->size * sizeof(cfix_bin_t));
+	h->bin = bin;
+#ifdef CFIX_FILTER
+	{
+		uint16_t *filter = cfix_filter_reuse(h->bins);
+
+		memcpy(filter, h->filter, h->bins * sizeof(uint16_t));
+		h->filter = filter;
+	}
+#endif
+	if (h->slab != NULL) {
+		cfix_uint_t *slab = cfix_slab_reuse((size_t)h->slab_cap * h->data);
+
+		memcpy(slab, h->slab, (size_t)h->slab_cap * h->data * sizeof(cfix_uint_t));
+		h->slab = slab;
+	}
+	--cow->refs;
+}
+
+/*
+ * Writer side of the seqlock protocol - the version counter is odd while a
+ * mutation is in flight and even when the table is consistent.  Without
+ * CFIX_SEQLOCK begin is free and end degenerates to the plain version bump
+ * mutators have always performed.
+ */
+	static inline void
+cfix_write_begin(cfix_t *h)
+{
+	if (h->cow != NULL) cfix_cow_break(h);
+#ifdef CFIX_SEQLOCK
+	__atomic_store_n(&h->version, h->version + 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+	static inline void
+cfix_write_end(cfix_t *h)
+{
+#ifdef CFIX_SEQLOCK
+	__atomic_store_n(&h->version, h->version + 1, __ATOMIC_SEQ_CST);
+#else
+	++h->version;
+#endif
+}
+
+/*
+ * Check whether a bin array was adopted from a snapshot mapping (see
+ * cfix_load) rather than allocated through m2.
+ */
+	static inline bool
+cfix_bin_mapped(cfix_t *h, cfix_bin_t *bin)
+{
+	return h->map != NULL &&
+		(char *)bin >= (char *)h->map &&
+		(char *)bin < (char *)h->map + h->maplen;
+}
+
+/*
+ * Release a bin array for real - munmap for arrays adopted from a snapshot,
+ * m2 recycling for everything else.
+ */
+	static void
+cfix_bin_release(cfix_t *h, cfix_bin_t *bin, size_t n, uint16_t *filter, size_t fbins)
+{
+	if (cfix_bin_mapped(h, bin)) {
+		munmap(h->map, h->maplen);
+		h->map = NULL;
+		h->maplen = 0;
+	} else {
+		cfix_bin_recycle(bin, n);
+	}
+	if (filter != NULL) cfix_filter_recycle(filter, fbins);
+}
+
+/*
+ * Retire a bin array that concurrent readers may still be probing.  Without
+ * CFIX_SEQLOCK there are no concurrent readers and the array is released on
+ * the spot.
+ */
+	static void
+cfix_bin_retire(cfix_t *h, cfix_bin_t *bin, size_t n, uint16_t *filter, size_t fbins)
+{
+#ifdef CFIX_SEQLOCK
+	assert(h->retired_count < CFIX_RETIRED);
+	h->retired[h->retired_count].bin = bin;
+	h->retired[h->retired_count].size = n;
+	h->retired[h->retired_count].filter = filter;
+	h->retired[h->retired_count].fbins = fbins;
+	if (cfix_bin_mapped(h, bin)) {
+		h->retired[h->retired_count].map = h->map;
+		h->retired[h->retired_count].maplen = h->maplen;
+		h->map = NULL;
+		h->maplen = 0;
+	} else {
+		h->retired[h->retired_count].map = NULL;
+		h->retired[h->retired_count].maplen = 0;
+	}
+	h->retired[h->retired_count].slab = NULL;
+	h->retired[h->retired_count].slabw = 0;
+	++h->retired_count;
+#else
+	cfix_bin_release(h, bin, n, filter, fbins);
+#endif
+}
+
+/*
+ * Retire a payload slab outgrown in indirect mode - like cfix_bin_retire,
+ * concurrent seqlock readers may still be resolving handles against it.
+ */
+	static void
+cfix_slab_retire(cfix_t *h, cfix_uint_t *slab, size_t words)
+{
+#ifdef CFIX_SEQLOCK
+	assert(h->retired_count < CFIX_RETIRED);
+	memset(&h->retired[h->retired_count], 0, sizeof(h->retired[0]));
+	h->retired[h->retired_count].slab = slab;
+	h->retired[h->retired_count].slabw = words;
+	++h->retired_count;
+#else
+	(void)h;
+	cfix_slab_recycle(slab, words);
+#endif
+}
+
+/*
+ * Allocate a payload record in indirect mode, growing the slab by doubling
+ * when the free list is exhausted.  Record zero of every fresh region is
+ * threaded onto the free list along with the rest.
+ */
+	static uint32_t
+cfix_slab_get(cfix_t *h)
+{
+	uint32_t idx;
+
+	if (h->slab_free == CFIX_SLAB_NIL) {
+		uint32_t cap = h->slab_cap == 0 ? 2 * CFIX_BIN_SIZE : 2 * h->slab_cap, i;
+		cfix_uint_t *slab = cfix_slab_reuse((size_t)cap * h->data);
+
+		if (h->slab != NULL) {
+			memcpy(slab, h->slab, (size_t)h->slab_cap * h->data * sizeof(cfix_uint_t));
+			cfix_slab_retire(h, h->slab, (size_t)h->slab_cap * h->data);
+		}
+		h->slab = slab;
+		for (i = h->slab_cap; i < cap; i++) {
+			slab[(size_t)i * h->data] = (i + 1 < cap) ? i + 1 : CFIX_SLAB_NIL;
+		}
+		h->slab_free = h->slab_cap;
+		h->slab_cap = cap;
+	}
+	idx = h->slab_free;
+	h->slab_free = (uint32_t)h->slab[(size_t)idx * h->data];
+	return idx;
+}
+
+	static void
+cfix_slab_put(cfix_t *h, uint32_t idx)
+{
+	h->slab[(size_t)idx * h->data] = h->slab_free;
+	h->slab_free = idx;
+}
+
+	void
+cfix_reclaim(cfix_t *h)
+{
+#ifdef CFIX_SEQLOCK
+	uint32_t i;
+
+	for (i = 0; i < h->retired_count; i++) {
+		if (h->retired[i].bin == NULL) {
+			cfix_slab_recycle(h->retired[i].slab, h->retired[i].slabw);
+			continue;
+		}
+		if (h->retired[i].map != NULL) {
+			munmap(h->retired[i].map, h->retired[i].maplen);
+		} else {
+			cfix_bin_recycle(h->retired[i].bin, h->retired[i].size);
+		}
+		if (h->retired[i].filter != NULL) {
+			cfix_filter_recycle(h->retired[i].filter, h->retired[i].fbins);
+		}
+	}
+	h->retired_count = 0;
+#else
+	(void)h;
+#endif
+}
+
 	static cfix_iter_t *
 cfix_iter_reuse(void)
 {
-	if (cfix_iter_handle == NULL) {
-		cfix_iter_handle = m2_create("cfix_iter_t", sizeof(cfix_iter_t));
-	}
+	pthread_once(&cfix_handle_once, cfix_handle_init);
 	return (cfix_iter_t *)m2_reuse(cfix_iter_handle, 1, false);
 }
 
@@ -176,24 +753,35 @@ cfix_bins(cfix_t *h)
 	return h->bins;
 }
 
-	uint32_t
+	cfix_uint_t
 cfix_min(cfix_t *h)
 {
 	return h->min;
 }
 
-	uint32_t
+	cfix_uint_t
 cfix_max(cfix_t *h)
 {
 	return h->max;
 }
 
+/*
+ * In power-of-two mode prix is the log2 of the bin count rather than an
+ * index into the prime table.
+ */
+	static uint32_t
+cfix_prix_to_bins(cfix_t *h, uint32_t prix)
+{
+	if (h->ptwo) return (uint32_t)1 << prix;
+	return hash_primes_index_to_number(prix);
+}
+
 	static uint32_t
-cfix_keys_to_prix(uint32_t keys)
+cfix_keys_to_prix(cfix_t *h, uint32_t keys)
 {
 	uint32_t result;
 
-	for (result = 0; hash_primes_index_to_number(result) * CFIX_BIN_SIZE < keys; result++) {
+	for (result = 0; cfix_prix_to_bins(h, result) * CFIX_BIN_SIZE < keys; result++) {
 	}
 
 	return result;
@@ -210,6 +798,10 @@ cfix_bin_init(cfix_t *h)
 			cfix_data_clear(h, b, o);
 		}
 	}
+
+	memset(h->count.hist, 0, sizeof(h->count.hist));
+	h->count.hist[0] = h->bins;
+	h->count.primary = 0;
 }
 
 #ifdef CFIX_VERBOSE
@@ -219,7 +811,7 @@ cfix_bin_dump(cfix_t *h, uint32_t base)
 	uint32_t offset;
 
 	for  (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
-		fprintf(stderr, "%010u ", CFIX_KEY(h, base, offset));
+		fprintf(stderr, "%010llu ", (unsigned long long)CFIX_KEY(h, base, offset));
 	}
 	fprintf(stderr, "\n");
 }
@@ -244,8 +836,8 @@ cfix_bin_check(cfix_t *h, uint32_t base)
 	uint32_t o;
 
 	for (o = 0; o < CFIX_BIN_SIZE - 1; o++) {
-		uint32_t curr = CFIX_KEY(h, base, o),
-				 next = CFIX_KEY(h, base, o + 1);
+		cfix_uint_t curr = CFIX_KEY(h, base, o),
+					next = CFIX_KEY(h, base, o + 1);
 
 		if (curr < next) continue;
 		if (curr > next) {
@@ -269,7 +861,7 @@ cfix_bin_check(cfix_t *h, uint32_t base)
 cfix_bin_locate(
 		cfix_t *h,
 		uint32_t base,
-		uint32_t key,
+		cfix_uint_t key,
 		uint32_t *offset)
 {
 #ifdef CFIX_BIN_LOCATE_LINEAR
@@ -284,10 +876,12 @@ cfix_bin_locate(
 		if (key < cfix_key(h, h->bin[base][o])) return false;
 	}
 #elif defined(CFIX_BIN_LOCATE_BINARY)
-	uint32_t *a0 = &CFIX_KEY(h, base, 0), *a;
+	cfix_uint_t *a0 = &CFIX_KEY(h, base, 0), *a;
 
 	a = a0;
+#ifndef CFIX_KEY64
 	a += (key >= a[8]) << 3;
+#endif
 	a += (key >= a[4]) << 2;
 	a += (key >= a[2]) << 1;
 	a += (key >= a[1]) << 0;
@@ -295,7 +889,47 @@ cfix_bin_locate(
 		*offset = (uint32_t)(a - a0);
 		return true;
 	}
-	for (uint32_t o = 0; o < CFIX_BIN_SIZE; o++) assert(key != CFIX_KEY(h, base, o)); 
+#ifdef CFIX_CHECK
+	for (uint32_t o = 0; o < CFIX_BIN_SIZE; o++) assert(key != CFIX_KEY(h, base, o));
+#endif
+	return false;
+#elif defined(CFIX_BIN_LOCATE_SIMD)
+	cfix_uint_t *a0 = &CFIX_KEY(h, base, 0);
+	uint32_t m;
+
+#ifdef CFIX_KEY64
+#if defined(__AVX512F__)
+	m = (uint32_t)_mm512_cmpeq_epi64_mask(
+			_mm512_load_si512((const void *)a0),
+			_mm512_set1_epi64((long long)key));
+#else
+	__m256i k4 = _mm256_set1_epi64x((long long)key);
+	uint32_t lo = (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(
+				_mm256_cmpeq_epi64(_mm256_load_si256((const __m256i *)a0), k4))),
+			 hi = (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(
+				_mm256_cmpeq_epi64(_mm256_load_si256((const __m256i *)(a0 + 4)), k4)));
+
+	m = lo | (hi << 4);
+#endif
+#else
+#if defined(__AVX512F__)
+	m = (uint32_t)_mm512_cmpeq_epi32_mask(
+			_mm512_load_si512((const void *)a0),
+			_mm512_set1_epi32((int)key));
+#else
+	__m256i k8 = _mm256_set1_epi32((int)key);
+	uint32_t lo = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+				_mm256_cmpeq_epi32(_mm256_load_si256((const __m256i *)a0), k8))),
+			 hi = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+				_mm256_cmpeq_epi32(_mm256_load_si256((const __m256i *)(a0 + 8)), k8)));
+
+	m = lo | (hi << 8);
+#endif
+#endif
+	if (m != 0) {
+		*offset = (uint32_t)__builtin_ctz(m);
+		return true;
+	}
 	return false;
 #else
 #	error "Bin locate search method not specified!"
@@ -329,12 +963,22 @@ cfix_create(
 
 	(*h)->keys = 0;
 
-	(*h)->prix = cfix_keys_to_prix(conf->start);
-	(*h)->bins = hash_primes_index_to_number((*h)->prix);
+	(*h)->ptwo = conf->ptwo;
+	(*h)->prix = cfix_keys_to_prix(*h, conf->start);
+	(*h)->bins = cfix_prix_to_bins(*h, (*h)->prix);
+	(*h)->magic = hash_primes_magic((*h)->bins);
 
-	(*h)->size = conf->data + 1;
+	(*h)->data = conf->data;
+	(*h)->indirect = conf->indirect != 0 && conf->data > 0;
+	(*h)->size = (*h)->indirect ? 2 : conf->data + 1;
+	(*h)->slab = NULL;
+	(*h)->slab_cap = 0;
+	(*h)->slab_free = CFIX_SLAB_NIL;
 
 	(*h)->bin = cfix_bin_reuse(((*h)->bins * (*h)->size));
+#ifdef CFIX_FILTER
+	(*h)->filter = cfix_filter_reuse((*h)->bins);
+#endif
 	cfix_bin_init(*h);
 
 	(*h)->version = 0l;
@@ -348,6 +992,19 @@ cfix_create(
 
 	(*h)->min = CFIX_INF;
 	(*h)->max = 0;
+
+	(*h)->migrate = conf->migrate;
+	(*h)->shrink = false;
+	(*h)->frozen = false;
+	(*h)->mig_bin = NULL;
+	(*h)->mig_bins = 0;
+	(*h)->mig_next = 0;
+	(*h)->mig_freed = 0;
+	(*h)->mig_keys = 0;
+
+	(*h)->map = NULL;
+	(*h)->maplen = 0;
+	(*h)->cow = NULL;
 #ifdef CFIX_INFDATA
 	(*h)->infdata = NULL;
 #endif
@@ -356,50 +1013,100 @@ cfix_create(
 	void
 cfix_destroy(cfix_t **h)
 {
-	cfix_bin_recycle((*h)->bin, (*h)->bins * (*h)->size);
+	cfix_reclaim(*h);
+	if ((*h)->mig_bin != NULL) cfix_bin_release(*h, (*h)->mig_bin, (*h)->mig_bins * (*h)->size, (*h)->mig_filter, (*h)->mig_bins);
+	if ((*h)->cow != NULL) {
+		cfix_cow_unref((*h)->cow);
+	} else {
+		cfix_bin_release(*h, (*h)->bin, (*h)->bins * (*h)->size, (*h)->filter, (*h)->bins);
+		if ((*h)->slab != NULL) cfix_slab_recycle((*h)->slab, (size_t)(*h)->slab_cap * (*h)->data);
+	}
 	cfix_recycle((*h));
 	(*h) = NULL;
 }
 
-	cfix_t *
-cfix_clone(cfix_t *h)
+/*
+ * Common body of cfix_clone and cfix_snapshot - a new handle sharing the bin
+ * array with h through a copy-on-write descriptor.  No bin is copied here;
+ * the first mutation of either handle detaches it with a private copy (see
+ * cfix_cow_break).
+ */
+	static cfix_t *
+cfix_share(cfix_t *h)
 {
 	cfix_t *result;
 
+	cfix_migrate_finish(h);
+	cfix_cow_share(h);
+
 	result = cfix_reuse();
 
 	memcpy(result, h, sizeof(cfix_t));
 
-	result->bin = cfix_bin_reuse(result->bins * result->size);
-
-	memcpy(result->bin, h->bin, result->bins * result->size * CFIX_BIN_SIZE * sizeof(uint32_t));
+	result->map = NULL;
+	result->maplen = 0;
+	result->mig_filter = NULL;
+#ifdef CFIX_SEQLOCK
+	result->retired_count = 0;
+#endif
 
 #ifdef CFIX_INFDATA
 	if (result->infdata != NULL) {
 		result->infdata = result->_infdata;
-		memcpy(result->infdata, h->infdata, (h->size - 1) * sizeof(uint32_t));
+		memcpy(result->infdata, h->infdata, h->data * sizeof(cfix_uint_t));
 	}
 #endif
 
 	return result;
 }
 
+	cfix_t *
+cfix_clone(cfix_t *h)
+{
+	return cfix_share(h);
+}
+
+	cfix_t *
+cfix_snapshot(cfix_t *h)
+{
+	return cfix_share(h);
+}
+
 	static inline bool
 cfix_locate(
 		cfix_t *h,
-		uint32_t key,
+		cfix_uint_t key,
 		uint32_t *base,
 		uint32_t *offset,
-		uint32_t **data)
+		cfix_uint_t **data)
 {
-	(*base) = cfix_full_avalanche(key) % h->bins;
+	uint32_t full;
+#ifdef CFIX_FILTER
+	uint16_t tag;
+#endif
+
+	if (key < h->min || key > h->max) return false;
+
+	full = cfix_full_avalanche(key);
+	(*base) = CFIX_MOD(h, full);
+#ifdef CFIX_FILTER
+	tag = (uint16_t)1 << (full & 0xf);
+	if ((h->filter[(*base)] & tag) != 0)
+#endif
 	if (cfix_bin_locate(h, (*base), key, offset)) {
 		(*data) = CFIX_DATA(h, *base, *offset);
+		/* Relaxed - probes run under concurrent readers (cfix_par rdlock,
+		 * shared snapshots) and a plain increment would be a data race. */
+		__atomic_fetch_add(&h->count.locate_primary, 1, __ATOMIC_RELAXED);
 		return true;
 	}
-	(*base) = cfix_half_avalanche(key) % h->bins;
+	(*base) = CFIX_MOD(h, cfix_half_avalanche(key));
+#ifdef CFIX_FILTER
+	if ((h->filter[(*base)] & tag) != 0)
+#endif
 	if (cfix_bin_locate(h, (*base), key, offset)) {
 		(*data) = CFIX_DATA(h, *base, *offset);
+		__atomic_fetch_add(&h->count.locate_secondary, 1, __ATOMIC_RELAXED);
 		return true;
 	}
 	return false;
@@ -414,7 +1121,7 @@ cfix_entry_move(
 {
 	CFIX_KEY(h, dst_base, dst_offset) = CFIX_KEY(h, src_base, src_offset);
 	if (h->size == 1) return;
-	memcpy(CFIX_DATA(h, dst_base, dst_offset), CFIX_DATA(h, src_base, src_offset), (h->size - 1) * sizeof(uint32_t));
+	memcpy(CFIX_DATA(h, dst_base, dst_offset), CFIX_DATA(h, src_base, src_offset), (h->size - 1) * sizeof(cfix_uint_t));
 }
 
 	static void
@@ -422,37 +1129,37 @@ cfix_entry_copy(
 		cfix_t *h,
 		uint32_t src_base,
 		uint32_t src_offset,
-		uint32_t *dst_entry)
+		cfix_uint_t *dst_entry)
 {
 	assert(dst_entry != NULL);
 	(*dst_entry) = CFIX_KEY(h, src_base, src_offset);
 	if (h->size == 1) return;
-	memcpy(dst_entry + 1, CFIX_DATA(h, src_base, src_offset), (h->size - 1) * sizeof(uint32_t));
+	memcpy(dst_entry + 1, CFIX_DATA(h, src_base, src_offset), (h->size - 1) * sizeof(cfix_uint_t));
 }
 
 	static void
 cfix_entry_paste(
 		cfix_t *h,
-		uint32_t *src_entry,
+		cfix_uint_t *src_entry,
 		uint32_t dst_base,
 		uint32_t dst_offset)
 {
 	assert(src_entry != NULL);
 	CFIX_KEY(h, dst_base, dst_offset) = (*src_entry);
 	if (h->size == 1) return;
-	memcpy(CFIX_DATA(h, dst_base, dst_offset), src_entry + 1, (h->size - 1) * sizeof(uint32_t));
+	memcpy(CFIX_DATA(h, dst_base, dst_offset), src_entry + 1, (h->size - 1) * sizeof(cfix_uint_t));
 }
 
 	static void
 cfix_data_store(
 		cfix_t *h,
-		uint32_t *src_data,
+		cfix_uint_t *src_data,
 		uint32_t dst_base,
 		uint32_t dst_offset)
 {
 	if (h->size == 1) return;
 	assert(src_data != NULL);
-	memcpy(CFIX_DATA(h, dst_base, dst_offset), src_data, (h->size - 1) * sizeof(uint32_t));
+	memcpy(CFIX_DATA(h, dst_base, dst_offset), src_data, (h->size - 1) * sizeof(cfix_uint_t));
 }
 
 	static void
@@ -460,11 +1167,15 @@ cfix_data_retrieve(
 		cfix_t *h,
 		uint32_t src_base,
 		uint32_t src_offset,
-		uint32_t *dst_data)
+		cfix_uint_t *dst_data)
 {
 	if (h->size == 1) return;
 	assert(dst_data != NULL);
-	memcpy(dst_data, CFIX_DATA(h, src_base, src_offset), (h->size - 1) * sizeof(uint32_t));
+	if (h->indirect) {
+		memcpy(dst_data, CFIX_SLAB(h, (uint32_t)*CFIX_DATA(h, src_base, src_offset)), h->data * sizeof(cfix_uint_t));
+		return;
+	}
+	memcpy(dst_data, CFIX_DATA(h, src_base, src_offset), (h->size - 1) * sizeof(cfix_uint_t));
 }
 
 	static void
@@ -473,7 +1184,8 @@ cfix_data_clear(
 		uint32_t base,
 		uint32_t offset)
 {
-	uint32_t i, *d;
+	uint32_t i;
+	cfix_uint_t *d;
 
 	if (h->size == 1) return;
 	d = CFIX_DATA(h, base, offset);
@@ -486,7 +1198,8 @@ cfix_data_empty(
 		uint32_t base,
 		uint32_t offset)
 {
-	uint32_t i, *d;
+	uint32_t i;
+	cfix_uint_t *d;
 
 	if (h->size == 1) return true;
 	d = CFIX_DATA(h, base, offset);
@@ -494,13 +1207,40 @@ cfix_data_empty(
 	return true;
 }
 
+/*
+ * Resolve the payload location of an occupied slot - through the slab in
+ * indirect mode, in place otherwise.  All the entry primitives above work on
+ * the in-bin representation (key plus handle in indirect mode) so relocation
+ * never touches the payload; only the API boundary resolves it.
+ */
+	static inline cfix_uint_t *
+cfix_data_ptr(cfix_t *h, uint32_t base, uint32_t offset)
+{
+	if (h->indirect) return CFIX_SLAB(h, (uint32_t)*CFIX_DATA(h, base, offset));
+	return CFIX_DATA(h, base, offset);
+}
+
+/*
+ * Overwrite the payload of an occupied slot with caller data.
+ */
+	static void
+cfix_data_write(cfix_t *h, cfix_uint_t *src_data, uint32_t base, uint32_t offset)
+{
+	if (h->size == 1) return;
+	if (h->indirect) {
+		memcpy(cfix_data_ptr(h, base, offset), src_data, h->data * sizeof(cfix_uint_t));
+		return;
+	}
+	cfix_data_store(h, src_data, base, offset);
+}
+
 	static void
 cfix_roll_left(
 		cfix_t *h,
 		uint32_t base,
 		uint32_t offset)
 {
-	uint32_t key = CFIX_KEY(h, base, offset),
+	cfix_uint_t key = CFIX_KEY(h, base, offset),
 			 o,
 			 entry[CFIX_DATA_MAXSIZE + 1];
 
@@ -522,7 +1262,7 @@ cfix_roll_right(
 		uint32_t base,
 		uint32_t offset)
 {
-	uint32_t key = CFIX_KEY(h, base, offset),
+	cfix_uint_t key = CFIX_KEY(h, base, offset),
 			 o,
 			 entry[CFIX_DATA_MAXSIZE + 1];
 
@@ -539,13 +1279,32 @@ cfix_roll_right(
 #endif
 }
 
+/*
+ * Place an entry in a bin known to have a free slot, keeping the bin sorted
+ * and its filter word current.  Bin occupancy accounting is left to the
+ * caller - the parallel rebuild workers account per destination range
+ * instead of touching the shared counters.
+ */
+	static void
+cfix_bin_place(cfix_t *h, cfix_uint_t key, cfix_uint_t *data, uint32_t base)
+{
+	assert(CFIX_KEY(h, base, CFIX_BIN_SIZE - 1) == CFIX_INF);
+	CFIX_KEY(h, base, CFIX_BIN_SIZE - 1) = key;
+	cfix_data_store(h, data, base, CFIX_BIN_SIZE - 1);
+	cfix_roll_left(h, base, CFIX_BIN_SIZE - 1);
+#ifdef CFIX_FILTER
+	h->filter[base] |= (uint16_t)1 << (cfix_full_avalanche(key) & 0xf);
+#endif
+}
+
+#ifndef CFIX_CUCKOO_BFS
 	static void
 cfix_adjust(
 		cfix_t *h,
 		uint32_t base,
 		uint32_t *offset)
 {
-	uint32_t entry[CFIX_DATA_MAXSIZE + 1];
+	cfix_uint_t entry[CFIX_DATA_MAXSIZE + 1];
 
 	for (;;) {
 		uint32_t new_offset;
@@ -578,34 +1337,169 @@ cfix_adjust(
 		(*offset) = new_offset;
 	}
 }
+#endif
+
+#ifdef CFIX_CUCKOO_BFS
+/** @brief Node in the breadth-first cuckoo path search queue. */
+struct cfix_bfs_node {
+	uint32_t bin;		/*< Bin this node would free a slot in. */
+	cfix_uint_t key;	/*< Key hopping from the parent bin into this bin. */
+	int32_t parent;		/*< Index of parent node, -1 for a root. */
+	uint32_t depth;		/*< Number of hops from the root. */
+};
 
+/*
+ * Breadth-first cuckoo insertion - both candidate bins are full, so search
+ * for a shortest chain of entry hops ending in a bin with a free slot.  The
+ * search touches only keys; entries (and their data) are moved exactly once
+ * each, and only after a complete path has been found, so there is nothing
+ * to undo on failure.
+ */
 	static bool
-cfix_cuckoo(
+cfix_cuckoo_path(
 		cfix_t *h,
-		uint32_t key,
-		uint32_t *data,
+		cfix_uint_t key,
+		cfix_uint_t *data,
+		uint32_t base_full,
+		uint32_t base_half,
 		uint32_t ttl)
 {
-	uint32_t base_full, base_half, offset, cand_offset, cand_key, *cand_data, cand_entry[CFIX_DATA_MAXSIZE + 1];
+	struct cfix_bfs_node node[CFIX_BFS_NODES];
+	cfix_uint_t entry[CFIX_DATA_MAXSIZE + 1];
+	uint32_t head, tail, o, off, count;
+	int32_t found = -1, i, p;
+	bool located;
+
+	node[0].bin = base_full;
+	node[0].key = key;
+	node[0].parent = -1;
+	node[0].depth = 0;
+	node[1].bin = base_half;
+	node[1].key = key;
+	node[1].parent = -1;
+	node[1].depth = 0;
+	tail = 2;
+
+	for (head = 0; head < tail && found < 0; head++) {
+		if (node[head].depth >= ttl) continue;
+		for (o = 0; o < CFIX_BIN_SIZE && tail < CFIX_BFS_NODES; o++) {
+			cfix_uint_t k = CFIX_KEY(h, node[head].bin, o),
+					 prim = CFIX_MOD(h, cfix_full_avalanche(k)),
+					 alt = (prim == node[head].bin) ?
+							CFIX_MOD(h, cfix_half_avalanche(k)) : prim;
+
+			if (alt == node[head].bin) continue;
+			node[tail].bin = alt;
+			node[tail].key = k;
+			node[tail].parent = (int32_t)head;
+			node[tail].depth = node[head].depth + 1;
+			if (CFIX_KEY(h, alt, CFIX_BIN_SIZE - 1) == CFIX_INF) {
+				found = (int32_t)tail;
+				break;
+			}
+			++tail;
+		}
+	}
+	if (found < 0) return false;
 
-	if (ttl == 0) {
-		/* Maximum recursive depth reached. */
-		return false;
+	/*
+	 * Execute the path from the free bin back to the root, moving one entry
+	 * per hop.  Entries are re-located by key because earlier hops may have
+	 * shifted offsets when a bin occurs more than once on the path.
+	 */
+	for (i = found; node[i].parent >= 0; i = p) {
+		cfix_uint_t k = node[i].key;
+
+		p = node[i].parent;
+		located = cfix_bin_locate(h, node[p].bin, k, &off);
+		assert(located);
+		(void)located;
+		cfix_entry_copy(h, node[p].bin, off, entry);
+
+		count = cfix_bin_count(h, node[i].bin);
+		assert(CFIX_KEY(h, node[i].bin, CFIX_BIN_SIZE - 1) == CFIX_INF);
+		cfix_entry_paste(h, entry, node[i].bin, CFIX_BIN_SIZE - 1);
+		cfix_roll_left(h, node[i].bin, CFIX_BIN_SIZE - 1);
+#ifdef CFIX_FILTER
+		h->filter[node[i].bin] |= (uint16_t)1 << (cfix_full_avalanche(k) & 0xf);
+#endif
+		--h->count.hist[count];
+		++h->count.hist[count + 1];
+
+		count = cfix_bin_count(h, node[p].bin);
+		CFIX_KEY(h, node[p].bin, off) = CFIX_INF;
+		cfix_data_clear(h, node[p].bin, off);
+		cfix_roll_right(h, node[p].bin, off);
+		--h->count.hist[count];
+		++h->count.hist[count - 1];
+
+		/* The two bins of a hop are the two hash bins of the key, so the
+		 * move always toggles primary residency of the hopped entry. */
+		if (node[i].bin == CFIX_MOD(h, cfix_full_avalanche(k))) {
+			++h->count.primary;
+		} else {
+			--h->count.primary;
+		}
+		++h->count.displaced;
 	}
 
 	/*
-	 * Trying to insert in primary block.
+	 * The root bin now has a free slot - place the new key.
 	 */
+	count = cfix_bin_count(h, node[i].bin);
+	assert(CFIX_KEY(h, node[i].bin, CFIX_BIN_SIZE - 1) == CFIX_INF);
+	CFIX_KEY(h, node[i].bin, CFIX_BIN_SIZE - 1) = key;
+	cfix_data_store(h, data, node[i].bin, CFIX_BIN_SIZE - 1);
+	cfix_roll_left(h, node[i].bin, CFIX_BIN_SIZE - 1);
+#ifdef CFIX_FILTER
+	h->filter[node[i].bin] |= (uint16_t)1 << (cfix_full_avalanche(key) & 0xf);
+#endif
+	--h->count.hist[count];
+	++h->count.hist[count + 1];
+	if (node[i].bin == base_full) ++h->count.primary;
 
-	base_full = cfix_full_avalanche(key) % h->bins;
+	return true;
+}
+#endif
+
+	static bool
+cfix_cuckoo(
+		cfix_t *h,
+		cfix_uint_t key,
+		cfix_uint_t *data,
+		uint32_t ttl)
+{
+	uint32_t base_full, base_half, count;
+#ifndef CFIX_CUCKOO_BFS
+	uint32_t offset, cand_offset;
+	cfix_uint_t cand_key, *cand_data, cand_entry[CFIX_DATA_MAXSIZE + 1];
+#endif
+
+	if (ttl == 0) {
+		/* Maximum recursive depth reached. */
+		return false;
+	}
+
+	/*
+	 * Trying to insert in primary block.
+	 */
+
+	base_full = CFIX_MOD(h, cfix_full_avalanche(key));
 #ifdef CFIX_CHECK
 	assert(cfix_bin_check(h, base_full));
 #endif
 	if (CFIX_KEY(h, base_full, CFIX_BIN_SIZE - 1) == CFIX_INF) {
 		assert(cfix_data_empty(h, base_full, CFIX_BIN_SIZE - 1));
+		count = cfix_bin_count(h, base_full);
 		CFIX_KEY(h, base_full, CFIX_BIN_SIZE - 1) = key;
 		cfix_data_store(h, data, base_full, CFIX_BIN_SIZE - 1);
 		cfix_roll_left(h, base_full, CFIX_BIN_SIZE - 1);
+#ifdef CFIX_FILTER
+		h->filter[base_full] |= (uint16_t)1 << (cfix_full_avalanche(key) & 0xf);
+#endif
+		--h->count.hist[count];
+		++h->count.hist[count + 1];
+		++h->count.primary;
 		return true;
 	}
 
@@ -613,18 +1507,31 @@ cfix_cuckoo(
 	 * Primary block full - try secondary block.
 	 */
 
-	base_half = cfix_half_avalanche(key) % h->bins;
+	base_half = CFIX_MOD(h, cfix_half_avalanche(key));
 #ifdef CFIX_CHECK
 	assert(cfix_bin_check(h, base_half));
 #endif
 	if (CFIX_KEY(h, base_half, CFIX_BIN_SIZE - 1) == CFIX_INF) {
 		assert(cfix_data_empty(h, base_half, CFIX_BIN_SIZE - 1));
+		count = cfix_bin_count(h, base_half);
 		CFIX_KEY(h, base_half, CFIX_BIN_SIZE - 1) = key;
 		cfix_data_store(h, data, base_half, CFIX_BIN_SIZE - 1);
 		cfix_roll_left(h, base_half, CFIX_BIN_SIZE - 1);
+#ifdef CFIX_FILTER
+		h->filter[base_half] |= (uint16_t)1 << (cfix_full_avalanche(key) & 0xf);
+#endif
+		--h->count.hist[count];
+		++h->count.hist[count + 1];
 		return true;
 	}
 
+#ifdef CFIX_CUCKOO_BFS
+	/*
+	 * Both blocks full - breadth-first search for an eviction path.
+	 */
+
+	return cfix_cuckoo_path(h, key, data, base_full, base_half, ttl);
+#else
 	/*
 	 * Secondary block full - locate candidate in primary block to move.
 	 */
@@ -632,7 +1539,7 @@ cfix_cuckoo(
 	for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
 		cand_key = CFIX_KEY(h, base_full, offset);
 
-		if (base_full == cfix_full_avalanche(cand_key) % h->bins) {
+		if (base_full == CFIX_MOD(h, cfix_full_avalanche(cand_key))) {
 			/* Primary block is also primary block for candidate. */
 			cfix_entry_copy(h, base_full, offset, cand_entry);
 			cand_data = cand_entry + 1;
@@ -641,8 +1548,13 @@ cfix_cuckoo(
 			CFIX_KEY(h, base_full, cand_offset) = key;
 			cfix_data_store(h, data, base_full, cand_offset);
 			cfix_adjust(h, base_full, &cand_offset);
+#ifdef CFIX_FILTER
+			/* The displaced candidate's bit stays set - a harmless false positive. */
+			h->filter[base_full] |= (uint16_t)1 << (cfix_full_avalanche(key) & 0xf);
+#endif
 
 			if (cfix_cuckoo(h, cand_key, cand_data, ttl - 1)) {
+				++h->count.displaced;
 				return true;
 			}
 
@@ -661,7 +1573,7 @@ cfix_cuckoo(
 	for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
 		cand_key = CFIX_KEY(h, base_half, offset);
 
-		if (base_half == cfix_full_avalanche(cand_key) % h->bins) {
+		if (base_half == CFIX_MOD(h, cfix_full_avalanche(cand_key))) {
 			/* Primary block is also primary block for candidate. */
 			cfix_entry_copy(h, base_half, offset, cand_entry);
 			cand_data = cand_entry + 1;
@@ -670,8 +1582,14 @@ cfix_cuckoo(
 			CFIX_KEY(h, base_half, cand_offset) = key;
 			cfix_data_store(h, data, base_half, cand_offset);
 			cfix_adjust(h, base_half, &cand_offset);
+#ifdef CFIX_FILTER
+			h->filter[base_half] |= (uint16_t)1 << (cfix_full_avalanche(key) & 0xf);
+#endif
+			/* The candidate was primary here, the new key is not. */
+			--h->count.primary;
 
 			if (cfix_cuckoo(h, cand_key, cand_data, ttl - 1)) {
+				++h->count.displaced;
 				return true;
 			}
 
@@ -680,6 +1598,7 @@ cfix_cuckoo(
 			cfix_entry_paste(h, cand_entry, base_half, cand_offset);
 			cfix_adjust(h, base_half, &cand_offset);
 			assert(cand_offset == offset);
+			++h->count.primary;
 		}
 	}
 
@@ -687,21 +1606,314 @@ cfix_cuckoo(
 	 * Insertion failed!
 	 */
 	return false;
+#endif
+}
+
+/*
+ * Release the physical pages behind a consumed range of old bins.  Ranges
+ * are trimmed to 2M boundaries so the call also works on huge page backed
+ * arrays, and the advice is best effort - dropped pages read back as zero,
+ * which in seqlock mode a racing reader may observe but never act on (its
+ * probe fails version validation and is retried).
+ */
+	static void
+cfix_bin_dontneed(cfix_t *old, uint32_t from, uint32_t to)
+{
+	const uintptr_t align = (uintptr_t)1 << 21;
+	uintptr_t lo = (uintptr_t)old->bin + (uintptr_t)from * old->size * sizeof(cfix_bin_t),
+			  hi = (uintptr_t)old->bin + (uintptr_t)to * old->size * sizeof(cfix_bin_t);
+
+	lo = (lo + align - 1) & ~(align - 1);
+	hi = hi & ~(align - 1);
+	if (lo < hi) madvise((void *)lo, (size_t)(hi - lo), MADV_DONTNEED);
+}
+
+/*
+ * Build a stack view of the old bin array during incremental resize so the
+ * regular bin primitives can be used on it.  Returns false when no migration
+ * is in progress.
+ */
+	static inline bool
+cfix_mig_view(cfix_t *h, cfix_t *mig)
+{
+	if (h->mig_bin == NULL) return false;
+	memcpy(mig, h, sizeof(cfix_t));
+	mig->bin = h->mig_bin;
+	mig->bins = h->mig_bins;
+	mig->magic = h->mig_magic;
+	mig->filter = h->mig_filter;
+	return true;
+}
+
+	static void
+cfix_grow(cfix_t *h, cfix_uint_t key, cfix_uint_t *data);
+
+/*
+ * Start an incremental resize towards a given prime index - the current bin
+ * array becomes the old array and a new array takes its place.  Keys are
+ * moved over by cfix_migrate_step until the old array is drained.  Works in
+ * both directions; growth and shrink only differ in how the target is
+ * chosen.
+ */
+	static void
+cfix_migrate_start_to(cfix_t *h, uint32_t prix)
+{
+	uint32_t bins;
+
+	assert(h->mig_bin == NULL);
+
+	bins = cfix_prix_to_bins(h, prix);
+
+	h->mig_bin = h->bin;
+	h->mig_bins = h->bins;
+	h->mig_magic = h->magic;
+	h->mig_filter = h->filter;
+	h->mig_next = 0;
+	h->mig_freed = 0;
+	h->mig_keys = h->keys;
+#ifdef CFIX_INFDATA
+	if (h->infdata != NULL) --h->mig_keys;
+#endif
+
+	h->prix = prix;
+	if (bins >= h->mig_bins) {
+		/* Growing - publish the (larger) array before the new bin count (see
+		 * cfix_grow). */
+		h->bin = cfix_bin_reuse(bins * h->size);
+#ifdef CFIX_FILTER
+		h->filter = cfix_filter_reuse(bins);
+#endif
+		h->bins = bins;
+	} else {
+		/* Shrinking - publish the (smaller) bin count before the new array
+		 * so a racing seqlock reader never indexes beyond the live
+		 * allocation. */
+		h->bins = bins;
+#ifdef CFIX_FILTER
+		h->filter = cfix_filter_reuse(bins);
+#endif
+		h->bin = cfix_bin_reuse(bins * h->size);
+	}
+	h->magic = hash_primes_magic(bins);
+	cfix_bin_init(h);
+}
+
+/*
+ * Start an incremental growth migration.
+ */
+	static void
+cfix_migrate_start(cfix_t *h)
+{
+	double factor;
+	uint32_t prix;
+
+	if (h->ptwo) {
+		/* Exact doubling. */
+		prix = h->prix + 1;
+	} else {
+		factor = h->growth + h->attempt + h->random * drand48();
+		prix = (uint32_t)((double)h->prix * factor);
+		if (prix < h->prix + 1) prix = h->prix + 1;
+	}
+
+	++h->count.grows;
+
+	cfix_migrate_start_to(h, prix);
+}
+
+/*
+ * Migrate up to budget old bins into the new array.  Keys keep living in
+ * exactly one of the two arrays - a migrated old bin is cleared so probes of
+ * the old array cannot find stale copies.
+ */
+	static void
+cfix_migrate_step(cfix_t *h, uint32_t budget)
+{
+	cfix_t mig;
+	uint32_t offset;
+
+	if (!cfix_mig_view(h, &mig)) return;
+
+	for (; budget > 0 && h->mig_next < h->mig_bins; budget--, h->mig_next++) {
+		uint32_t base = h->mig_next;
+
+		for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
+			cfix_uint_t k = CFIX_KEY(&mig, base, offset);
+
+			if (k == CFIX_INF) break;
+
+			if (!cfix_cuckoo(h, k, CFIX_DATA(&mig, base, offset), CFIX_TTL(h))) {
+				/* New array full - grow it synchronously and go on.  The old
+				 * array is not touched by cfix_grow. */
+				cfix_grow(h, k, CFIX_DATA(&mig, base, offset));
+				--h->keys;	/* cfix_grow counted k as a new key. */
+			}
+			if (k < h->min) h->min = k;
+			if (k > h->max) h->max = k;
+			--h->mig_keys;
+			++h->count.moved;
+		}
+		for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
+			CFIX_KEY(&mig, base, offset) = CFIX_INF;
+		}
+		if (mig.filter != NULL) mig.filter[base] = 0;
+	}
+
+#ifdef CFIX_FILTER
+	/*
+	 * Drop the pages behind the drained bins to keep peak RSS near one
+	 * table.  Only safe with the filter: its cleared words keep probes of
+	 * the old array from ever touching the dropped pages, whose zeroes
+	 * would otherwise look like key 0.
+	 */
+	if (h->mig_next - h->mig_freed >= CFIX_RELEASE_CHUNK) {
+		cfix_bin_dontneed(&mig, h->mig_freed, h->mig_next);
+		h->mig_freed = h->mig_next;
+	}
+#endif
+
+	if (h->mig_next == h->mig_bins) {
+		/* Migration complete. */
+		assert(h->mig_keys == 0);
+		cfix_bin_retire(h, h->mig_bin, h->mig_bins * h->size, h->mig_filter, h->mig_bins);
+		h->mig_bin = NULL;
+		h->mig_filter = NULL;
+	}
+}
+
+/*
+ * Complete any migration in progress - used by operations that require a
+ * single consistent bin array (rebuild, clone, iteration, statistics).
+ */
+	static void
+cfix_migrate_finish(cfix_t *h)
+{
+	while (h->mig_bin != NULL) cfix_migrate_step(h, h->mig_bins);
 }
 
 	bool
-cfix_insert(cfix_t *h, uint32_t key, uint32_t *data)
+cfix_migrate(cfix_t *h, uint32_t budget)
+{
+	if (h->mig_bin == NULL) return false;
+
+	cfix_write_begin(h);
+	if (budget == 0) {
+		cfix_migrate_finish(h);
+	} else {
+		cfix_migrate_step(h, budget);
+	}
+	cfix_write_end(h);
+
+	return h->mig_bin != NULL;
+}
+
+/*
+ * Grow the hash table, re-inserting every key in the current bin array plus
+ * the pending (key, data) pair, retrying with ever larger bin counts until
+ * cuckoo insertion succeeds for all of them.  The caller is responsible for
+ * the version bump.
+ */
+	static void
+cfix_grow(cfix_t *h, cfix_uint_t key, cfix_uint_t *data)
 {
 	cfix_t old;
 	double factor;
-	uint32_t base, offset, attempt, *old_data;
+	uint32_t base, offset, attempt = 1;
+
+	++h->count.grows;
+
+	memcpy(&old, h, sizeof(cfix_t));
+
+	for (;;) {
+		uint32_t bins;
+
+		if (h->ptwo) {
+			h->prix = old.prix + attempt;
+		} else {
+			factor =
+				h->growth +
+				h->attempt * attempt +
+				h->random * drand48();
+			h->prix = (uint32_t)((double)old.prix * factor);
+			if (h->prix < old.prix + attempt) h->prix = old.prix + attempt;
+		}
+
+		bins = cfix_prix_to_bins(h, h->prix);
+
+#ifdef CFIX_VERBOSE
+		fprintf(stderr, "GROWTH: %u -> %u\n", old.bins, bins);
+#endif
+
+		h->keys = 0;
+#ifdef CFIX_INFDATA
+		if (h->infdata != NULL) ++h->keys;
+#endif
+		h->min = CFIX_INF;
+		h->max = 0;
+		/* Growing - publish the (larger) array before the new bin count so a
+		 * racing seqlock reader never indexes beyond the live allocation. */
+		h->bin = cfix_bin_reuse(bins * h->size);
+#ifdef CFIX_FILTER
+		h->filter = cfix_filter_reuse(bins);
+#endif
+		h->bins = bins;
+		h->magic = hash_primes_magic(bins);
+		cfix_bin_init(h);
+
+		assert(cfix_cuckoo(h, key, data, CFIX_TTL(h)));
+		h->min = h->max = key;
+		h->keys++;
+
+		for (base = 0; base < old.bins; base++) {
+			for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
+				cfix_uint_t k = CFIX_KEY(&old, base, offset);
+
+				if (k == CFIX_INF) break;
+
+				if (cfix_cuckoo(h, k, CFIX_DATA(&old, base, offset), CFIX_TTL(h))) {
+					if (h->keys == 0 || k < h->min) h->min = k;
+					if (h->keys == 0 || k > h->max) h->max = k;
+					++h->keys;
+					++h->count.moved;
+					continue;
+				}
+				/*
+				 * Insertion failed despite extension - scrap and retry.
+				 */
+				goto retry;
+			}
+		}
+		cfix_bin_retire(h, old.bin, old.bins * old.size, old.filter, old.bins);
+		h->keys += h->mig_keys;
+		return;
+retry:
+		cfix_bin_retire(h, h->bin, h->bins * h->size, h->filter, h->bins);
+		++h->count.retries;
+		++attempt;
+	}
+
+	/* *** NOT REACHED *** */
+	assert(0);
+}
+
+	bool
+cfix_insert(cfix_t *h, cfix_uint_t key, cfix_uint_t *data)
+{
+	cfix_t mig;
+	uint64_t displaced;
+	uint32_t base, offset;
+	cfix_uint_t *old_data, hword;
+
+	assert(!h->frozen);
 
 #ifdef CFIX_INFDATA
 	if (key == CFIX_INF) {
 		if (h->infdata == NULL) {
+			cfix_write_begin(h);
 			h->infdata = h->_infdata;
-			memcpy(h->infdata, data, (h->size - 1) * sizeof(uint32_t));
+			memcpy(h->infdata, data, h->data * sizeof(cfix_uint_t));
 			++h->keys;
+			cfix_write_end(h);
 			return true;
 		} else {
 			return false;
@@ -711,62 +1923,817 @@ cfix_insert(cfix_t *h, uint32_t key, uint32_t *data)
 	assert(key < CFIX_INF);
 #endif
 
-	if (cfix_locate(h, key, &base, &offset, &old_data)) return false;
+	if (cfix_locate(h, key, &base, &offset, &old_data)) return false;
+	if (cfix_mig_view(h, &mig) && cfix_locate(&mig, key, &base, &offset, &old_data)) return false;
+
+	cfix_write_begin(h);
+
+	if (h->indirect) {
+		/*
+		 * Park the payload in a slab record up front and insert the record
+		 * index as the entry's single data word - every relocation below
+		 * then moves one word no matter how wide the payload is.
+		 */
+		hword = (cfix_uint_t)cfix_slab_get(h);
+		memcpy(CFIX_SLAB(h, (uint32_t)hword), data, h->data * sizeof(cfix_uint_t));
+		data = &hword;
+	}
+
+	cfix_migrate_step(h, h->migrate);
+
+	displaced = h->count.displaced;
+
+	if ((double)(h->keys + 1) / ((double)h->bins * (double)CFIX_BIN_SIZE) > h->upper) {
+		/*
+		 * Consider as failed insertion and increase table size.
+		 */
+#ifdef CFIX_VERBOSE
+		fprintf(stderr, "FILLED:\n");
+#endif
+	} else if (cfix_cuckoo(h, key, data, CFIX_TTL(h))) {
+		/* Insertion successful. */
+		displaced = h->count.displaced - displaced;
+		++h->count.chain[displaced < CFIX_CHAIN_HIST ? displaced : CFIX_CHAIN_HIST - 1];
+		if (h->keys == 0 || key < h->min) h->min = key;
+		if (h->keys == 0 || key > h->max) h->max = key;
+		++h->keys;
+		cfix_write_end(h);
+		return true;
+	} else {
+#ifdef CFIX_VERBOSE
+		fprintf(stderr, "FAILED:\n");
+#endif
+	}
+
+	/* Insertion failed - extend hash table. */
+	if (h->migrate > 0 && h->mig_bin == NULL) {
+		/*
+		 * Incremental resize - keep the current array as the old array and
+		 * let subsequent operations drain it instead of rehashing here.
+		 */
+		cfix_migrate_start(h);
+		if (cfix_cuckoo(h, key, data, CFIX_TTL(h))) {
+			if (h->keys == 0 || key < h->min) h->min = key;
+			if (h->keys == 0 || key > h->max) h->max = key;
+			++h->keys;
+			cfix_write_end(h);
+			return true;
+		}
+		/* The fresh array cannot even hold the new key - fall through to
+		 * synchronous growth of it. */
+	}
+
+	cfix_grow(h, key, data);
+	cfix_write_end(h);
+	return true;
+}
+
+	void
+cfix_reserve(cfix_t *h, uint32_t n)
+{
+	uint32_t total;
+
+	assert(h != NULL);
+	assert(!h->frozen);
+
+	cfix_migrate_finish(h);
+
+	total = (uint32_t)((double)n / h->upper) + 1;
+	if (cfix_keys_to_prix(h, total) > h->prix) cfix_rebuild_to(h, total);
+}
+
+	static int
+cfix_bulk_compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a,
+			 y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+	bool
+cfix_insert_bulk(cfix_t *h, cfix_uint_t *keys, cfix_uint_t *data, uint32_t n)
+{
+	uint64_t *order;
+	uint32_t i;
+	bool result = true;
+
+	assert(h != NULL);
+	assert(!h->frozen);
+	assert(keys != NULL);
+	assert(data != NULL || h->size == 1);
+
+	if (n == 0) return true;
+
+	cfix_migrate_finish(h);
+
+	/*
+	 * Dimension the table once for all n keys so the insertion loop below
+	 * never triggers a rehash.
+	 */
+	cfix_reserve(h, h->keys + n);
+
+	pthread_once(&cfix_handle_once, cfix_handle_init);
+
+	/*
+	 * Sort the keys by primary bin so the fill pass walks the bin array
+	 * sequentially - only keys bumped to their secondary bin go random.
+	 */
+	order = (uint64_t *)m2_reuse(cfix_bulk_handle, n, false);
+	for (i = 0; i < n; i++) {
+		order[i] = ((uint64_t)CFIX_MOD(h, cfix_full_avalanche(keys[i])) << 32) | (uint64_t)i;
+	}
+	qsort(order, n, sizeof(uint64_t), cfix_bulk_compare);
+
+	for (i = 0; i < n; i++) {
+		uint32_t j = (uint32_t)order[i];
+
+		if (!cfix_insert(h, keys[j], data == NULL ? NULL : &data[j * h->data])) result = false;
+	}
+
+	m2_recycle(cfix_bulk_handle, (void *)order, n);
+	return result;
+}
+
+	uint32_t
+cfix_merge(cfix_t *dst, cfix_t *src)
+{
+	uint32_t base, offset, b, o, merged = 0;
+	cfix_uint_t *d;
+
+	assert(dst != NULL && src != NULL && dst != src);
+	assert(!dst->frozen && !src->frozen);
+	assert(dst->size == src->size);
+	assert(dst->data == src->data && dst->indirect == src->indirect);
+
+	cfix_migrate_finish(dst);
+	cfix_migrate_finish(src);
+
+	/*
+	 * Dimension dst once for all keys so the streaming loop below never
+	 * triggers a rehash.
+	 */
+	cfix_reserve(dst, dst->keys + src->keys);
+
+	cfix_write_begin(dst);
+	cfix_write_begin(src);
+
+	for (base = 0; base < src->bins; base++) {
+		for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
+			cfix_uint_t key = CFIX_KEY(src, base, offset);
+			cfix_uint_t *data, hword;
+
+			if (key == CFIX_INF) break;
+			if (cfix_locate(dst, key, &b, &o, &d)) continue;
+			if (dst->indirect) {
+				/* Payloads live in per-instance slabs - move the record into
+				 * dst's slab and insert the dst-side handle. */
+				hword = (cfix_uint_t)cfix_slab_get(dst);
+				memcpy(CFIX_SLAB(dst, (uint32_t)hword), cfix_data_ptr(src, base, offset), dst->data * sizeof(cfix_uint_t));
+				data = &hword;
+			} else {
+				data = CFIX_DATA(src, base, offset);
+			}
+			if (cfix_cuckoo(dst, key, data, CFIX_TTL(dst))) {
+				if (key < dst->min) dst->min = key;
+				if (key > dst->max) dst->max = key;
+				++dst->keys;
+			} else {
+				/*
+				 * dst was pre-sized, so this is rare - grow synchronously
+				 * like the rebuild paths do.  cfix_grow accounts for the
+				 * key itself, including min/max.
+				 */
+				cfix_grow(dst, key, data);
+			}
+			++merged;
+		}
+		if (((base + 1) % CFIX_RELEASE_CHUNK) == 0) {
+			/* Hand the physical pages behind consumed src bins back as the
+			 * merge advances, so peak RSS stays near the merged table. */
+			cfix_bin_dontneed(src, base + 1 - CFIX_RELEASE_CHUNK, base + 1);
+		}
+	}
+
+#ifdef CFIX_INFDATA
+	if (src->infdata != NULL) {
+		if (dst->infdata == NULL) {
+			dst->infdata = dst->_infdata;
+			memcpy(dst->infdata, src->infdata, dst->data * sizeof(cfix_uint_t));
+			++dst->keys;
+			++merged;
+		}
+		src->infdata = NULL;
+	}
+#endif
+
+	/*
+	 * src has been drained - retire its array and start over with a
+	 * minimally dimensioned one so the handle stays valid for reuse.
+	 */
+	{
+		cfix_bin_t *oldbin = src->bin;
+		uint32_t oldbins = src->bins;
+		uint16_t *oldfilter = src->filter;
+
+		src->keys = 0;
+		src->min = CFIX_INF;
+		src->max = 0;
+		src->shrink = false;
+		src->prix = cfix_keys_to_prix(src, 0);
+		/* Shrinking - publish the (smaller) count before the array (see
+		 * the shrink path). */
+		src->bins = cfix_prix_to_bins(src, src->prix);
+#ifdef CFIX_FILTER
+		src->filter = cfix_filter_reuse(src->bins);
+#endif
+		src->bin = cfix_bin_reuse(src->bins * src->size);
+		src->magic = hash_primes_magic(src->bins);
+		cfix_bin_init(src);
+		cfix_bin_retire(src, oldbin, oldbins * src->size, oldfilter, oldbins);
+		if (src->slab != NULL) {
+			cfix_slab_retire(src, src->slab, (size_t)src->slab_cap * src->data);
+			src->slab = NULL;
+			src->slab_cap = 0;
+			src->slab_free = CFIX_SLAB_NIL;
+		}
+	}
+
+	cfix_write_end(src);
+	cfix_write_end(dst);
+
+	return merged;
+}
+
+	static bool
+cfix_shrinkable(cfix_t *h)
+{
+	double fill = (double)h->keys / ((double)h->bins * (double)CFIX_BIN_SIZE);
+
+	if (h->mig_bin != NULL) return false;
+	if (h->keys <= CFIX_BIN_SIZE) return false;
+	if (h->ptwo) {
+		/* The retry ladder lands one level above the shrink target, so the
+		 * coarse power-of-two ladder needs at least two spare halvings. */
+		if (h->prix < 2) return false;
+		if ((double)h->keys > ((h->upper + h->lower) / 2) * (double)(h->bins >> 2) * (double)CFIX_BIN_SIZE) return false;
+	}
+
+	return fill < h->lower;
+}
+
+/*
+ * Start a shrink migration towards the midpoint fill between lower and
+ * upper.  The target lands one level above the computed floor, matching the
+ * first rung of the old synchronous retry ladder; cfix_grow backs the new
+ * array off further should it prove too small.
+ */
+	static void
+cfix_shrink_start(cfix_t *h)
+{
+	uint32_t shrink_prix, shrink_keys;
+
+	++h->count.shrinks;
+
+	if (h->ptwo) {
+		/* Coarse ladder - descend while the keys fit within the midpoint
+		 * fill one level further down. */
+		shrink_keys = (uint32_t)(((h->upper + h->lower) / 2) * (double)CFIX_BIN_SIZE);
+		for (shrink_prix = h->prix; shrink_prix > 0 && h->keys <= shrink_keys * cfix_prix_to_bins(h, shrink_prix - 1); shrink_prix--);
+	} else {
+		shrink_keys = (uint32_t)(((h->upper + h->lower) / 2) * (double)h->bins * (double)CFIX_BIN_SIZE);
+		for (shrink_prix = h->prix; shrink_keys < cfix_prix_to_bins(h, shrink_prix) * CFIX_BIN_SIZE; shrink_prix--);
+	}
+
+	assert(shrink_prix + 1 < h->prix);
+
+	cfix_migrate_start_to(h, shrink_prix + 1);
+}
+
+	bool
+cfix_delete(cfix_t *h, cfix_uint_t key)
+{
+	cfix_t mig;
+	uint32_t base, offset, count;
+	cfix_uint_t *data;
+
+	assert(!h->frozen);
+
+#ifdef CFIX_INFDATA
+	if (key == CFIX_INF) {
+		if (h->infdata == NULL) {
+			return false;
+		} else {
+			cfix_write_begin(h);
+			h->infdata = NULL;
+			--h->keys;
+			cfix_write_end(h);
+			return true;
+		}
+	}
+#else
+	assert(key < CFIX_INF);
+#endif
+
+	if (h->mig_bin != NULL) {
+		cfix_write_begin(h);
+		cfix_migrate_step(h, h->migrate);
+		cfix_write_end(h);
+	}
+
+	if (cfix_locate(h, key, &base, &offset, &data)) {
+		cfix_write_begin(h);
+
+		if (h->indirect) cfix_slab_put(h, (uint32_t)*CFIX_DATA(h, base, offset));
+		CFIX_KEY(h, base, offset) = CFIX_INF;
+		cfix_data_clear(h, base, offset);
+		cfix_roll_right(h, base, offset);
+#ifdef CFIX_FILTER
+		cfix_filter_rebuild(h, base);
+#endif
+		count = cfix_bin_count(h, base);
+		--h->count.hist[count + 1];
+		++h->count.hist[count];
+		if (base == CFIX_MOD(h, cfix_full_avalanche(key))) --h->count.primary;
+	} else if (cfix_mig_view(h, &mig) && cfix_locate(&mig, key, &base, &offset, &data)) {
+		/* Key still lives in the old array of an incremental resize. */
+		cfix_write_begin(h);
+
+		if (h->indirect) cfix_slab_put(h, (uint32_t)*CFIX_DATA(&mig, base, offset));
+		CFIX_KEY(&mig, base, offset) = CFIX_INF;
+		cfix_data_clear(&mig, base, offset);
+		cfix_roll_right(&mig, base, offset);
+#ifdef CFIX_FILTER
+		cfix_filter_rebuild(&mig, base);
+#endif
+		--h->mig_keys;
+	} else {
+		return false;
+	}
+
+	--h->keys;
+	if (h->keys == 0) h->min = h->max = CFIX_INF;
+
+	if (cfix_shrinkable(h)) {
+		if (h->migrate == 0) {
+			/*
+			 * Stop-the-world mode - shrink inline via a drained migration.
+			 */
+			cfix_shrink_start(h);
+			cfix_migrate_finish(h);
+		} else {
+			/*
+			 * Incremental mode - only mark the table shrink-pending so this
+			 * delete returns immediately; cfix_maintain starts and advances
+			 * the shrink from application idle time.
+			 */
+			h->shrink = true;
+		}
+	}
+
+	cfix_write_end(h);
+	return true;
+}
+
+	bool
+cfix_maintain(cfix_t *h, uint32_t budget)
+{
+	if (h->shrink && h->mig_bin == NULL) {
+		h->shrink = false;
+		/* Re-validate - inserts since the mark may have refilled the table. */
+		if (cfix_shrinkable(h)) {
+			cfix_write_begin(h);
+			cfix_shrink_start(h);
+			cfix_write_end(h);
+		}
+	}
+
+	if (h->mig_bin == NULL) return h->shrink;
+
+	return cfix_migrate(h, budget) || h->shrink;
+}
+
+/*
+ * Rebuild the table into a fresh bin array dimensioned for keys.  The old
+ * array is consumed in chunks whose pages are released as soon as they are
+ * drained, so peak RSS stays near one table instead of old plus new - which
+ * also means a failed insertion cannot scrap and rescan the old array;
+ * instead the new array is grown synchronously and the rebuild carries on.
+ */
+	static void
+cfix_rebuild_to(cfix_t *h, uint32_t keys)
+{
+	cfix_t old;
+	uint32_t bins, base, offset;
+
+	cfix_migrate_finish(h);
+
+	++h->count.rebuilds;
+
+	/* Snapshot the old state after cfix_write_begin - the copy-on-write
+	 * break must run first so old never captures an array that clones or
+	 * snapshots still reference. */
+	cfix_write_begin(h);
+
+	memcpy(&old, h, sizeof(cfix_t));
+
+	h->prix = cfix_keys_to_prix(h, keys);
+	bins = cfix_prix_to_bins(h, h->prix);
+
+#ifdef CFIX_VERBOSE
+	fprintf(stderr, "COMPRESS: prix = %u, bins = %u, ratio %.2f%%\n", h->prix, bins, 100.0 * (float)old.keys / (float)(bins * CFIX_BIN_SIZE));
+#endif
+	h->keys = 0;
+#ifdef CFIX_INFDATA
+	if (h->infdata != NULL) ++h->keys;
+#endif
+	h->min = CFIX_INF;
+	h->max = 0;
+	/* Publish array and count in racing-reader-safe order (see growth
+	 * and shrink paths). */
+	if (bins >= h->bins) {
+		h->bin = cfix_bin_reuse(bins * h->size);
+#ifdef CFIX_FILTER
+		h->filter = cfix_filter_reuse(bins);
+#endif
+		h->bins = bins;
+	} else {
+		h->bins = bins;
+#ifdef CFIX_FILTER
+		h->filter = cfix_filter_reuse(bins);
+#endif
+		h->bin = cfix_bin_reuse(bins * h->size);
+	}
+	h->magic = hash_primes_magic(bins);
+	cfix_bin_init(h);
+
+	for (base = 0; base < old.bins; base++) {
+		for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
+			cfix_uint_t k = CFIX_KEY(&old, base, offset);
+
+			if (k == CFIX_INF) break;
+
+			if (cfix_cuckoo(h, k, CFIX_DATA(&old, base, offset), CFIX_TTL(h))) {
+				if (h->keys == 0 || k < h->min) h->min = k;
+				if (h->keys == 0 || k > h->max) h->max = k;
+				++h->keys;
+				++h->count.moved;
+				continue;
+			}
+			/*
+			 * Target too small - grow the new array synchronously and go
+			 * on.  cfix_grow accounts for k itself, including min/max.
+			 */
+			cfix_grow(h, k, CFIX_DATA(&old, base, offset));
+			++h->count.moved;
+		}
+		if (((base + 1) % CFIX_RELEASE_CHUNK) == 0) {
+			cfix_bin_dontneed(&old, base + 1 - CFIX_RELEASE_CHUNK, base + 1);
+		}
+	}
+	cfix_bin_retire(h, old.bin, old.bins * old.size, old.filter, old.bins);
+	cfix_write_end(h);
+}
+
+	void
+cfix_rebuild(cfix_t *h, double ratio)
+{
+	assert(!h->frozen);
+	assert((CFIX_RATIO_MIN <= ratio) && (ratio <= (double)1.0));
+
+	cfix_rebuild_to(h, (uint32_t)((double)h->keys / ratio));
+}
+
+/** @brief Per-worker state for the parallel rebuild - see cfix_rebuild_par. */
+struct cfix_rebuild_par_arg {
+	cfix_t *h;			/*< Destination instance - already dimensioned. */
+	cfix_t *old;		/*< Stack copy of the pre-rebuild state. */
+	uint32_t nthreads;	/*< Number of workers. */
+	uint32_t src_from;	/*< First old bin of the worker's scan range. */
+	uint32_t src_to;	/*< One past the last old bin of the scan range. */
+	uint32_t dst_from;	/*< First new bin of the worker's insert range. */
+	uint32_t dst_to;	/*< One past the last new bin of the insert range. */
+	cfix_uint_t *slab;	/*< Scratch slab holding the scanned entries partitioned by destination owner. */
+	size_t slabn;		/*< Allocation size of the slab in uint64_t's. */
+	cfix_uint_t *seg[CFIX_REBUILD_PAR_MAX];	/*< Start of the slab segment per destination owner. */
+	uint32_t segn[CFIX_REBUILD_PAR_MAX];	/*< Number of entries per destination owner. */
+	uint32_t leftn[CFIX_REBUILD_PAR_MAX];	/*< Entries left unplaced per destination owner - compacted at the segment start. */
+	struct cfix_rebuild_par_arg *all;		/*< All worker states - insert workers drain every scanner's segment. */
+	uint32_t placed;	/*< Entries placed by this insert worker. */
+	cfix_uint_t min;	/*< Smallest key placed. */
+	cfix_uint_t max;	/*< Largest key placed. */
+	uint32_t primary;	/*< Keys in their primary bin over the insert range. */
+	uint32_t hist[CFIX_BIN_SIZE + 1];		/*< Occupancy histogram over the insert range. */
+};
+
+/*
+ * Map a destination bin to the insert worker owning it - the inverse of the
+ * range split in cfix_rebuild_par.
+ */
+	static inline uint32_t
+cfix_rebuild_par_owner(cfix_t *h, uint32_t nthreads, uint32_t base)
+{
+	return (uint32_t)(((uint64_t)base * nthreads) / h->bins);
+}
+
+/*
+ * Scan phase - each worker walks a disjoint old-bin range twice, first
+ * counting entries per destination owner, then filling its scratch slab with
+ * (key, data) entries grouped by owner, so the insert phase needs no locks.
+ */
+	static void *
+cfix_rebuild_par_scan(void *p)
+{
+	struct cfix_rebuild_par_arg *arg = (struct cfix_rebuild_par_arg *)p;
+	cfix_t *h = arg->h, *old = arg->old;
+	cfix_uint_t *cur[CFIX_REBUILD_PAR_MAX];
+	uint32_t base, offset, i, total = 0;
+
+	for (base = arg->src_from; base < arg->src_to; base++) {
+		for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
+			cfix_uint_t k = CFIX_KEY(old, base, offset);
+
+			if (k == CFIX_INF) break;
+			++arg->segn[cfix_rebuild_par_owner(h, arg->nthreads, CFIX_MOD(h, cfix_full_avalanche(k)))];
+			++total;
+		}
+	}
+
+	if (total == 0) return NULL;
+	arg->slabn = ((size_t)total * h->size * sizeof(cfix_uint_t) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	arg->slab = (cfix_uint_t *)m2_reuse(cfix_bulk_handle, arg->slabn, false);
+	for (i = 0; i < arg->nthreads; i++) {
+		arg->seg[i] = (i == 0) ? arg->slab : arg->seg[i - 1] + (size_t)arg->segn[i - 1] * h->size;
+		cur[i] = arg->seg[i];
+	}
+
+	for (base = arg->src_from; base < arg->src_to; base++) {
+		for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
+			cfix_uint_t k = CFIX_KEY(old, base, offset), o;
+
+			if (k == CFIX_INF) break;
+			o = cfix_rebuild_par_owner(h, arg->nthreads, CFIX_MOD(h, cfix_full_avalanche(k)));
+			cur[o][0] = k;
+			if (h->size > 1) memcpy(cur[o] + 1, CFIX_DATA(old, base, offset), (h->size - 1) * sizeof(cfix_uint_t));
+			cur[o] += h->size;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Insert phase - each worker owns a disjoint destination bin range and
+ * drains every scanner's segment for that range.  Entries go to their
+ * primary bin, or to their secondary bin when it happens to fall in the same
+ * range; the rest are compacted in place at the segment start for the
+ * sequential leftover pass.  Occupancy and primary-residency counters are
+ * recomputed per range at the end to keep the shared counters untouched.
+ */
+	static void *
+cfix_rebuild_par_insert(void *p)
+{
+	struct cfix_rebuild_par_arg *arg = (struct cfix_rebuild_par_arg *)p;
+	cfix_t *h = arg->h;
+	uint32_t w, i, base, offset, j = cfix_rebuild_par_owner(h, arg->nthreads, arg->dst_from);
+
+	for (w = 0; w < arg->nthreads; w++) {
+		struct cfix_rebuild_par_arg *src = &arg->all[w];
+		cfix_uint_t *e = src->seg[j], *left = e;
+
+		for (i = 0; i < src->segn[j]; i++, e += h->size) {
+			cfix_uint_t k = e[0];
+			uint32_t full = CFIX_MOD(h, cfix_full_avalanche(k)),
+					 half;
+
+			if (CFIX_KEY(h, full, CFIX_BIN_SIZE - 1) == CFIX_INF) {
+				cfix_bin_place(h, k, e + 1, full);
+			} else {
+				half = CFIX_MOD(h, cfix_half_avalanche(k));
+				if (half < arg->dst_from || half >= arg->dst_to ||
+						CFIX_KEY(h, half, CFIX_BIN_SIZE - 1) != CFIX_INF) {
+					memmove(left, e, h->size * sizeof(cfix_uint_t));
+					left += h->size;
+					++src->leftn[j];
+					continue;
+				}
+				cfix_bin_place(h, k, e + 1, half);
+			}
+			if (k < arg->min) arg->min = k;
+			if (k > arg->max) arg->max = k;
+			++arg->placed;
+		}
+	}
+
+	for (base = arg->dst_from; base < arg->dst_to; base++) {
+		uint32_t count = cfix_bin_count(h, base);
+
+		++arg->hist[count];
+		for (offset = 0; offset < count; offset++) {
+			if (base == CFIX_MOD(h, cfix_full_avalanche(CFIX_KEY(h, base, offset)))) ++arg->primary;
+		}
+	}
+	return NULL;
+}
+
+	void
+cfix_rebuild_par(cfix_t *h, double ratio, uint32_t nthreads)
+{
+	struct cfix_rebuild_par_arg arg[CFIX_REBUILD_PAR_MAX];
+	pthread_t thread[CFIX_REBUILD_PAR_MAX];
+	cfix_t old;
+	uint32_t keys, bins, i, j, c;
+
+	assert(!h->frozen);
+	assert((CFIX_RATIO_MIN <= ratio) && (ratio <= (double)1.0));
+
+	keys = (uint32_t)((double)h->keys / ratio);
+
+	cfix_migrate_finish(h);
+
+	bins = cfix_prix_to_bins(h, cfix_keys_to_prix(h, keys));
+	if (nthreads > CFIX_REBUILD_PAR_MAX) nthreads = CFIX_REBUILD_PAR_MAX;
+	if (nthreads > h->bins) nthreads = h->bins;
+	if (nthreads > bins) nthreads = bins;
+	if (nthreads < 2) {
+		cfix_rebuild_to(h, keys);
+		return;
+	}
+
+	++h->count.rebuilds;
+
+	cfix_write_begin(h);
+
+	memcpy(&old, h, sizeof(cfix_t));
+
+	h->prix = cfix_keys_to_prix(h, keys);
+	bins = cfix_prix_to_bins(h, h->prix);
+	h->keys = 0;
+#ifdef CFIX_INFDATA
+	if (h->infdata != NULL) ++h->keys;
+#endif
+	h->min = CFIX_INF;
+	h->max = 0;
+	/* Publish array and count in racing-reader-safe order (see growth
+	 * and shrink paths). */
+	if (bins >= h->bins) {
+		h->bin = cfix_bin_reuse(bins * h->size);
+#ifdef CFIX_FILTER
+		h->filter = cfix_filter_reuse(bins);
+#endif
+		h->bins = bins;
+	} else {
+		h->bins = bins;
+#ifdef CFIX_FILTER
+		h->filter = cfix_filter_reuse(bins);
+#endif
+		h->bin = cfix_bin_reuse(bins * h->size);
+	}
+	h->magic = hash_primes_magic(bins);
+	cfix_bin_init(h);
+
+	pthread_once(&cfix_handle_once, cfix_handle_init);
+
+	memset(arg, 0, sizeof(struct cfix_rebuild_par_arg) * nthreads);
+	for (i = 0; i < nthreads; i++) {
+		arg[i].h = h;
+		arg[i].old = &old;
+		arg[i].nthreads = nthreads;
+		arg[i].src_from = (uint32_t)(((uint64_t)i * old.bins + nthreads - 1) / nthreads);
+		arg[i].src_to = (uint32_t)(((uint64_t)(i + 1) * old.bins + nthreads - 1) / nthreads);
+		arg[i].dst_from = (uint32_t)(((uint64_t)i * h->bins + nthreads - 1) / nthreads);
+		arg[i].dst_to = (uint32_t)(((uint64_t)(i + 1) * h->bins + nthreads - 1) / nthreads);
+		arg[i].all = arg;
+		arg[i].min = CFIX_INF;
+		arg[i].max = 0;
+	}
+
+	for (i = 1; i < nthreads; i++) {
+		assert(pthread_create(&thread[i], NULL, cfix_rebuild_par_scan, &arg[i]) == 0);
+	}
+	cfix_rebuild_par_scan(&arg[0]);
+	for (i = 1; i < nthreads; i++) {
+		assert(pthread_join(thread[i], NULL) == 0);
+	}
+
+	/* Every entry now lives in the scratch slabs - release the physical
+	 * pages behind the old array before the insert phase touches the new
+	 * one, keeping peak RSS near a single table. */
+	cfix_bin_dontneed(&old, 0, old.bins);
+
+	for (i = 1; i < nthreads; i++) {
+		assert(pthread_create(&thread[i], NULL, cfix_rebuild_par_insert, &arg[i]) == 0);
+	}
+	cfix_rebuild_par_insert(&arg[0]);
+	for (i = 1; i < nthreads; i++) {
+		assert(pthread_join(thread[i], NULL) == 0);
+	}
+
+	/*
+	 * Merge the per-range accounting, then push the few entries whose bins
+	 * straddle range boundaries through the ordinary cuckoo path.
+	 */
+	memset(h->count.hist, 0, sizeof(h->count.hist));
+	h->count.primary = 0;
+	for (i = 0; i < nthreads; i++) {
+		for (c = 0; c <= CFIX_BIN_SIZE; c++) h->count.hist[c] += arg[i].hist[c];
+		h->count.primary += arg[i].primary;
+		h->keys += arg[i].placed;
+		h->count.moved += arg[i].placed;
+		if (arg[i].min < h->min) h->min = arg[i].min;
+		if (arg[i].max > h->max) h->max = arg[i].max;
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		for (j = 0; j < nthreads; j++) {
+			cfix_uint_t *e = arg[i].seg[j];
+
+			for (c = 0; c < arg[i].leftn[j]; c++, e += h->size) {
+				if (cfix_cuckoo(h, e[0], e + 1, CFIX_TTL(h))) {
+					if (e[0] < h->min) h->min = e[0];
+					if (e[0] > h->max) h->max = e[0];
+					++h->keys;
+					++h->count.moved;
+					continue;
+				}
+				/*
+				 * Target too small - grow the new array synchronously and go
+				 * on.  cfix_grow accounts for the key itself.
+				 */
+				cfix_grow(h, e[0], e + 1);
+				++h->count.moved;
+			}
+		}
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		if (arg[i].slab != NULL) m2_recycle(cfix_bulk_handle, (void *)arg[i].slab, arg[i].slabn);
+	}
+
+	cfix_bin_retire(h, old.bin, old.bins * old.size, old.filter, old.bins);
+	cfix_write_end(h);
+}
+
+	void
+cfix_freeze(cfix_t *h)
+{
+	cfix_t old;
+	uint32_t base, offset, bins;
+
+	assert(h != NULL);
 
-	if ((double)(h->keys + 1) / ((double)h->bins * (double)CFIX_BIN_SIZE) > h->upper) {
-		/*
-		 * Consider as failed insertion and increase table size.
-		 */
-#ifdef CFIX_VERBOSE
-		fprintf(stderr, "FILLED:\n");
-#endif
-	} else if (cfix_cuckoo(h, key, data, CFIX_TTL(h))) {
-		/* Insertion successful. */
-		if (h->keys == 0 || key < h->min) h->min = key;
-		if (h->keys == 0 || key > h->max) h->max = key;
-		++h->keys;
-		++h->version;
-		return true;
-	} else {
-#ifdef CFIX_VERBOSE
-		fprintf(stderr, "FAILED:\n");
-#endif
-	}
+	if (h->frozen) return;
+
+	cfix_migrate_finish(h);
+
+	++h->count.rebuilds;
+
+	/* Snapshot the old state after cfix_write_begin - the copy-on-write
+	 * break must run first so old never captures an array that clones or
+	 * snapshots still reference. */
+	cfix_write_begin(h);
 
-	/* Insertion failed - extend hash table. */
-	attempt = 1;
 	memcpy(&old, h, sizeof(cfix_t));
 
+	/*
+	 * Pack into the fewest bins that can hold the present keys, scrapping
+	 * and stepping the prime index one notch per failed attempt instead of
+	 * applying the growth factors - a frozen table never grows back, so
+	 * spending the extra iterations on the tightest fit is worth it.
+	 */
+	h->prix = cfix_keys_to_prix(h, old.keys);
 	for (;;) {
-		factor =
-			h->growth +
-			h->attempt * attempt +
-			h->random * drand48();
-		h->prix = (uint32_t)((double)old.prix * factor);
-		if (h->prix < old.prix + attempt) h->prix = old.prix + attempt;
-
-		h->bins = hash_primes_index_to_number(h->prix);
+		bins = cfix_prix_to_bins(h, h->prix);
 
 #ifdef CFIX_VERBOSE
-		fprintf(stderr, "GROWTH: %u -> %u\n", old.bins, h->bins);
+		fprintf(stderr, "FREEZE: prix = %u, bins = %u, ratio %.2f%%\n", h->prix, bins, 100.0 * (float)old.keys / (float)(bins * CFIX_BIN_SIZE));
 #endif
-
 		h->keys = 0;
 #ifdef CFIX_INFDATA
 		if (h->infdata != NULL) ++h->keys;
 #endif
 		h->min = CFIX_INF;
 		h->max = 0;
-		h->bin = cfix_bin_reuse(h->bins * h->size);
+		/* Publish array and count in racing-reader-safe order (see growth
+		 * and shrink paths). */
+		if (bins >= h->bins) {
+			h->bin = cfix_bin_reuse(bins * h->size);
+#ifdef CFIX_FILTER
+			h->filter = cfix_filter_reuse(bins);
+#endif
+			h->bins = bins;
+		} else {
+			h->bins = bins;
+#ifdef CFIX_FILTER
+			h->filter = cfix_filter_reuse(bins);
+#endif
+			h->bin = cfix_bin_reuse(bins * h->size);
+		}
+		h->magic = hash_primes_magic(bins);
 		cfix_bin_init(h);
 
-		assert(cfix_cuckoo(h, key, data, CFIX_TTL(h)));
-		h->min = h->max = key;
-		h->keys++;
-
 		for (base = 0; base < old.bins; base++) {
 			for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
-				uint32_t k = CFIX_KEY(&old, base, offset);
+				cfix_uint_t k = CFIX_KEY(&old, base, offset);
 
 				if (k == CFIX_INF) break;
 
@@ -774,222 +2741,423 @@ cfix_insert(cfix_t *h, uint32_t key, uint32_t *data)
 					if (h->keys == 0 || k < h->min) h->min = k;
 					if (h->keys == 0 || k > h->max) h->max = k;
 					++h->keys;
+					++h->count.moved;
 					continue;
 				}
 				/*
-				 * Insertion failed despite extension - scrap and retry.
+				 * Too tight - scrap and retry one prime up.
 				 */
 				goto retry;
 			}
 		}
-		cfix_bin_recycle(old.bin, old.bins * old.size);
-		++h->version;
-		return true;
+		break;
 retry:
-		cfix_bin_recycle(h->bin, h->bins * h->size);
-		++attempt;
+		cfix_bin_retire(h, h->bin, h->bins * h->size, h->filter, h->bins);
+		++h->count.retries;
+		++h->prix;
 	}
 
-	/* *** NOT REACHED *** */
-	assert(0);
-	return false;
+	cfix_bin_retire(h, old.bin, old.bins * old.size, old.filter, old.bins);
+	h->frozen = true;
+	cfix_write_end(h);
 }
 
-	static bool
-cfix_shrinkable(cfix_t *h)
+	bool
+cfix_frozen(cfix_t *h)
 {
-	double fill = (double)h->keys / ((double)h->bins * (double)CFIX_BIN_SIZE);
-
-	if (h->keys <= CFIX_BIN_SIZE) return false;
-
-	return fill < h->lower;
+	return h->frozen;
 }
 
+/** @brief Snapshot file header - followed by the bin array at offset CFIX_FILE_BINOFF. */
+struct cfix_file {
+	uint64_t magic;		/*< CFIX_FILE_MAGIC - includes the format version. */
+	uint32_t prix;		/*< Prime index. */
+	uint32_t bins;		/*< Number of bins. */
+	uint32_t keys;		/*< Number of keys. */
+	uint32_t size;		/*< Entry size in words. */
+	uint32_t data;		/*< Data words per entry. */
+	uint32_t indirect;	/*< Non-zero if payloads live in a slab appended after the bin array. */
+	uint32_t slab_cap;	/*< Capacity of the appended slab in records. */
+	uint32_t slab_free;	/*< Head of the free record list or CFIX_SLAB_NIL. */
+	uint32_t depth;		/*< Maximum cuckoo depth. */
+	cfix_uint_t min;	/*< Smallest key. */
+	cfix_uint_t max;	/*< Largest key. */
+	uint32_t migrate;	/*< Incremental resize budget. */
+	uint32_t ptwo;		/*< Non-zero for power-of-two bin counts. */
+	uint32_t frozen;	/*< Non-zero if the table was frozen read-only. */
+	double lower;		/*< Lower fill threshold. */
+	double upper;		/*< Upper fill threshold. */
+	double growth;		/*< Growth factor. */
+	double attempt;		/*< Attempt factor. */
+	double random;		/*< Random factor. */
+	uint32_t infdata_present;				/*< Non-zero if data is associated with the infinity key. */
+	cfix_uint_t infdata[CFIX_DATA_MAXSIZE];	/*< Data associated with the infinity key. */
+};
+
 	bool
-cfix_delete(cfix_t *h, uint32_t key)
+cfix_save(cfix_t *h, const char *path)
 {
-	uint32_t base, offset, *data;
-
+	struct cfix_file file;
+	static const char pad[CFIX_FILE_BINOFF] = {0};
+	FILE *fp;
+	bool result = true;
+
+	cfix_migrate_finish(h);
+
+	memset(&file, 0, sizeof(file));
+	file.magic = CFIX_FILE_MAGIC;
+	file.prix = h->prix;
+	file.bins = h->bins;
+	file.keys = h->keys;
+	file.size = h->size;
+	file.data = h->data;
+	file.indirect = h->indirect;
+	file.slab_cap = h->slab_cap;
+	file.slab_free = h->slab_free;
+	file.depth = h->depth;
+	file.min = h->min;
+	file.max = h->max;
+	file.migrate = h->migrate;
+	file.ptwo = h->ptwo;
+	file.frozen = h->frozen;
+	file.lower = h->lower;
+	file.upper = h->upper;
+	file.growth = h->growth;
+	file.attempt = h->attempt;
+	file.random = h->random;
 #ifdef CFIX_INFDATA
-	if (key == CFIX_INF) {
-		if (h->infdata == NULL) {
-			return false;
-		} else {
-			h->infdata = NULL;
-			--h->keys;
-			return true;
-		}
+	if (h->infdata != NULL) {
+		file.infdata_present = 1;
+		memcpy(file.infdata, h->infdata, h->data * sizeof(cfix_uint_t));
 	}
-#else
-	assert(key < CFIX_INF);
 #endif
 
-	if (!cfix_locate(h, key, &base, &offset, &data)) return false;
+	fp = fopen(path, "wb");
+	if (fp == NULL) return false;
 
-	CFIX_KEY(h, base, offset) = CFIX_INF;
-	cfix_data_clear(h, base, offset);
-	cfix_roll_right(h, base, offset);
-	--h->keys;
-	++h->version;
-	if (h->keys == 0) h->min = h->max = CFIX_INF;
+	if (fwrite(&file, sizeof(file), 1, fp) != 1 ||
+			fwrite(pad, CFIX_FILE_BINOFF - sizeof(file), 1, fp) != 1 ||
+			fwrite(h->bin, h->bins * h->size * sizeof(cfix_bin_t), 1, fp) != 1) {
+		result = false;
+	}
+	if (result && h->indirect && h->slab_cap > 0 &&
+			fwrite(h->slab, (size_t)h->slab_cap * h->data * sizeof(cfix_uint_t), 1, fp) != 1) {
+		result = false;
+	}
+	if (fclose(fp) != 0) result = false;
+	return result;
+}
 
-	if (cfix_shrinkable(h)) {
-		/*
-		 * Decrease size of table.
-		 */
-		cfix_t old;
-		uint32_t attempt = 1, shrink_prix, shrink_keys;
+	bool
+cfix_load(cfix_t **h, const char *path)
+{
+	struct cfix_file *file;
+	struct stat st;
+	void *map;
+	uint32_t b, o;
+	int fd;
 
-		shrink_keys = (uint32_t)(((h->upper + h->lower) / 2) * (double)h->bins * (double)CFIX_BIN_SIZE);
-		for (shrink_prix = h->prix; shrink_keys < hash_primes_index_to_number(shrink_prix) * CFIX_BIN_SIZE; shrink_prix--);
+	assert(h != NULL);
+	(*h) = NULL;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
 
-		memcpy(&old, h, sizeof(cfix_t));
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < CFIX_FILE_BINOFF) {
+		close(fd);
+		return false;
+	}
+
+	/*
+	 * MAP_PRIVATE keeps the file intact while leaving the adopted bin array
+	 * mutable - pages are faulted in on demand and copied on first write.
+	 */
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return false;
+
+	file = (struct cfix_file *)map;
+	if (file->magic != CFIX_FILE_MAGIC ||
+			(size_t)st.st_size !=
+			CFIX_FILE_BINOFF + file->bins * file->size * sizeof(cfix_bin_t) +
+			(file->indirect ? (size_t)file->slab_cap * file->data * sizeof(cfix_uint_t) : 0)) {
+		munmap(map, (size_t)st.st_size);
+		return false;
+	}
 
-		for (;;) {
-			h->prix = (uint32_t)((double)shrink_prix + (double)(attempt - 1));
-			if (h->prix < shrink_prix + attempt) h->prix = shrink_prix + attempt;
+	(*h) = cfix_reuse();
 
-			assert(h->prix < old.prix);
-			h->bins = hash_primes_index_to_number(h->prix);
+	(*h)->bin = (cfix_bin_t *)((char *)map + CFIX_FILE_BINOFF);
+	(*h)->version = 0l;
+	(*h)->prix = file->prix;
+	(*h)->bins = file->bins;
+	(*h)->magic = hash_primes_magic(file->bins);
+	(*h)->keys = file->keys;
+	(*h)->size = file->size;
+	(*h)->data = file->data;
+	(*h)->indirect = file->indirect;
+	(*h)->depth = file->depth;
+	(*h)->min = file->min;
+	(*h)->max = file->max;
+	(*h)->migrate = file->migrate;
+	(*h)->ptwo = file->ptwo;
+	(*h)->lower = file->lower;
+	(*h)->upper = file->upper;
+	(*h)->growth = file->growth;
+	(*h)->attempt = file->attempt;
+	(*h)->random = file->random;
+	(*h)->frozen = file->frozen;
+
+	(*h)->shrink = false;
+	(*h)->mig_bin = NULL;
+	(*h)->mig_bins = 0;
+	(*h)->mig_next = 0;
+	(*h)->mig_freed = 0;
+	(*h)->mig_keys = 0;
+
+	(*h)->map = map;
+	(*h)->maplen = (size_t)st.st_size;
+	(*h)->cow = NULL;
 
-			h->keys = 0;
-#ifdef CFIX_INFDATA
-		if (h->infdata != NULL) ++h->keys;
+	/*
+	 * The slab is copied out of the mapping rather than adopted - a resize
+	 * retires the mapped bin array and munmaps the file, which must not pull
+	 * the payload records out from under the surviving table.
+	 */
+	(*h)->slab = NULL;
+	(*h)->slab_cap = 0;
+	(*h)->slab_free = CFIX_SLAB_NIL;
+	if ((*h)->indirect && file->slab_cap > 0) {
+		size_t slabw = (size_t)file->slab_cap * file->data;
+
+		(*h)->slab = cfix_slab_reuse(slabw);
+		memcpy((*h)->slab, (char *)map + CFIX_FILE_BINOFF +
+				file->bins * file->size * sizeof(cfix_bin_t), slabw * sizeof(cfix_uint_t));
+		(*h)->slab_cap = file->slab_cap;
+		(*h)->slab_free = file->slab_free;
+	}
+
+	/* Seed the incremental occupancy histogram and primary count - the one
+	 * place where they cannot be carried over. */
+#ifdef CFIX_FILTER
+	(*h)->filter = cfix_filter_reuse((*h)->bins);
 #endif
-			h->min = CFIX_INF;
-			h->max = 0;
-			h->bin = cfix_bin_reuse(h->bins * h->size);
-			cfix_bin_init(h);
-
-			for (base = 0; base < old.bins; base++) {
-				for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
-					uint32_t k = CFIX_KEY(&old, base, offset);
-
-					if (k == CFIX_INF) break;
-
-					if (cfix_cuckoo(h, k, CFIX_DATA(&old, base, offset), CFIX_TTL(h))) {
-						if (h->keys == 0 || k < h->min) h->min = k;
-						if (h->keys == 0 || k > h->max) h->max = k;
-						++h->keys;
-						continue;
-					}
-					/*
-					 * Insertion failed - scrap and retry.
-					 */
-					goto retry;
-				}
-			}
+	for (b = 0; b < (*h)->bins; b++) {
+#ifdef CFIX_FILTER
+		cfix_filter_rebuild(*h, b);
+#endif
+		++(*h)->count.hist[cfix_bin_count(*h, b)];
+		for (o = 0; o < CFIX_BIN_SIZE; o++) {
+			cfix_uint_t key = CFIX_KEY(*h, b, o);
 
-			cfix_bin_recycle(old.bin, old.bins * old.size);
-			return true;
-retry:
-			cfix_bin_recycle(h->bin, h->bins * h->size);
-			++attempt;
+			if (key == CFIX_INF) break;
+			if (b == CFIX_MOD(*h, cfix_full_avalanche(key))) ++(*h)->count.primary;
 		}
 	}
 
+#ifdef CFIX_INFDATA
+	if (file->infdata_present) {
+		(*h)->infdata = (*h)->_infdata;
+		memcpy((*h)->infdata, file->infdata, (*h)->data * sizeof(cfix_uint_t));
+	} else {
+		(*h)->infdata = NULL;
+	}
+#endif
+
 	return true;
 }
 
-	void
-cfix_rebuild(cfix_t *h, double ratio)
+	bool
+cfix_lookup(cfix_t *h, cfix_uint_t key, cfix_uint_t *data)
 {
-	cfix_t old;
-	uint32_t prix, keys, base, offset;
+	cfix_t mig;
+	uint32_t base, offset;
+	cfix_uint_t *__unused;
 
-	assert((CFIX_RATIO_MIN <= ratio) && (ratio <= (double)1.0));
+#ifdef CFIX_INFDATA
+	if (key == CFIX_INF) {
+		if (h->infdata == NULL) {
+			return false;
+		} else {
+			memcpy(data, h->infdata, h->data * sizeof(cfix_uint_t));
+			return true;
+		}
+	}
+#else
+	assert(key < CFIX_INF);
+#endif
 
-	memcpy(&old, h, sizeof(cfix_t));
+	if (cfix_locate(h, key, &base, &offset, &__unused)) {
+		cfix_data_retrieve(h, base, offset, data);
+		return true;
+	}
+	if (cfix_mig_view(h, &mig) && cfix_locate(&mig, key, &base, &offset, &__unused)) {
+		cfix_data_retrieve(&mig, base, offset, data);
+		return true;
+	}
+	return false;
+}
 
-	keys = (uint32_t)((double)h->keys / ratio);
-	prix = cfix_keys_to_prix(keys);
+	bool
+cfix_lookup_seq(cfix_t *h, cfix_uint_t key, cfix_uint_t *data)
+{
+#ifdef CFIX_SEQLOCK
+	uint64_t v1, v2;
+	bool result;
 
 	for (;;) {
-		h->prix = prix;
-		h->bins = hash_primes_index_to_number(h->prix);
-
-#ifdef CFIX_VERBOSE
-		fprintf(stderr, "COMPRESS: prix = %u, bins = %u, ratio %.2f%% ", h->prix, h->bins, 100.0 * (float)old.keys / (float)(h->bins * CFIX_BIN_SIZE));
-#endif
-		h->keys = 0;
-#ifdef CFIX_INFDATA
-		if (h->infdata != NULL) ++h->keys;
+		v1 = __atomic_load_n(&h->version, __ATOMIC_ACQUIRE);
+		if (v1 & 1) continue;	/* Mutation in flight - spin. */
+		result = cfix_lookup(h, key, data);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		v2 = __atomic_load_n(&h->version, __ATOMIC_ACQUIRE);
+		if (v1 == v2) return result;
+	}
+#else
+	return cfix_lookup(h, key, data);
 #endif
-		h->min = CFIX_INF;
-		h->max = 0;
-		h->bin = cfix_bin_reuse(h->bins * h->size);
-		cfix_bin_init(h);
+}
 
-		for (base = 0; base < old.bins; base++) {
-			for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
-				uint32_t k = CFIX_KEY(&old, base, offset);
+	bool
+cfix_lookup_batch(
+		cfix_t *h,
+		const cfix_uint_t *keys,
+		cfix_uint_t *data,
+		bool *results,
+		size_t n)
+{
+	cfix_t mig;
+	uint32_t base_full[CFIX_BATCH], base_half[CFIX_BATCH];
+	size_t i, j, k;
+	bool result = true, migp = cfix_mig_view(h, &mig);
 
-				if (k == CFIX_INF) break;
+	for (i = 0; i < n; i += k) {
+		k = (n - i) < CFIX_BATCH ? (n - i) : CFIX_BATCH;
 
-				if (cfix_cuckoo(h, k, CFIX_DATA(&old, base, offset), CFIX_TTL(h))) {
-					if (h->keys == 0 || k < h->min) h->min = k;
-					if (h->keys == 0 || k > h->max) h->max = k;
-					++h->keys;
-					continue;
+		/*
+		 * Hash and prefetch both candidate bins for the whole chunk so the
+		 * misses overlap instead of stalling one DRAM latency per probe.
+		 */
+		for (j = 0; j < k; j++) {
+			cfix_uint_t key = keys[i + j];
+
+			base_full[j] = CFIX_MOD(h, cfix_full_avalanche(key));
+			base_half[j] = CFIX_MOD(h, cfix_half_avalanche(key));
+			__builtin_prefetch(&CFIX_KEY(h, base_full[j], 0), 0, 0);
+			__builtin_prefetch(&CFIX_KEY(h, base_half[j], 0), 0, 0);
+		}
+
+		for (j = 0; j < k; j++) {
+			cfix_uint_t key = keys[i + j],
+						*d = h->size == 1 ? NULL : &data[(i + j) * h->data];
+			uint32_t offset;
+
+#ifdef CFIX_INFDATA
+			if (key == CFIX_INF) {
+				if (h->infdata == NULL) {
+					results[i + j] = false;
+					result = false;
+				} else {
+					memcpy(d, h->infdata, h->data * sizeof(cfix_uint_t));
+					results[i + j] = true;
 				}
-				/*
-				 * Insertion failed - scrap and retry.
-				 */
-				goto retry;
+				continue;
 			}
-		}
-		cfix_bin_recycle(old.bin, old.bins * old.size);
-		++h->version;
-#ifdef CFIX_VERBOSE
-		fprintf(stderr, "SUCCESS\n");
-#endif
-		return;
-retry:
-		cfix_bin_recycle(h->bin, h->bins * h->size);
-#ifdef CFIX_VERBOSE
-		fprintf(stderr, "FAILURE\n");
+#else
+			assert(key < CFIX_INF);
 #endif
-		++prix;
+
+			if (cfix_bin_locate(h, base_full[j], key, &offset)) {
+				cfix_data_retrieve(h, base_full[j], offset, d);
+				results[i + j] = true;
+				continue;
+			}
+			if (cfix_bin_locate(h, base_half[j], key, &offset)) {
+				cfix_data_retrieve(h, base_half[j], offset, d);
+				results[i + j] = true;
+				continue;
+			}
+			if (migp && cfix_locate(&mig, key, &base_full[j], &offset, &d)) {
+				cfix_data_retrieve(&mig, base_full[j], offset,
+						h->size == 1 ? NULL : &data[(i + j) * h->data]);
+				results[i + j] = true;
+				continue;
+			}
+			results[i + j] = false;
+			result = false;
+		}
 	}
+	return result;
+}
 
-	/* *** NOT REACHED *** */
-	assert(0);
+	void
+cfix_lookup_prepare(
+		cfix_t *h,
+		cfix_uint_t key,
+		cfix_ticket_t *ticket)
+{
+	ticket->key = key;
+	ticket->base_full = CFIX_MOD(h, cfix_full_avalanche(key));
+	ticket->base_half = CFIX_MOD(h, cfix_half_avalanche(key));
+	__builtin_prefetch(&CFIX_KEY(h, ticket->base_full, 0), 0, 0);
+	__builtin_prefetch(&CFIX_KEY(h, ticket->base_half, 0), 0, 0);
 }
 
 	bool
-cfix_lookup(cfix_t *h, uint32_t key, uint32_t *data)
+cfix_lookup_finish(
+		cfix_t *h,
+		cfix_ticket_t *ticket,
+		cfix_uint_t *data)
 {
-	uint32_t base, offset, *__unused;
+	cfix_t mig;
+	uint32_t base, offset;
+	cfix_uint_t *__unused;
 
 #ifdef CFIX_INFDATA
-	if (key == CFIX_INF) {
+	if (ticket->key == CFIX_INF) {
 		if (h->infdata == NULL) {
 			return false;
 		} else {
-			memcpy(data, h->infdata, (h->size - 1) * sizeof(uint32_t));
+			memcpy(data, h->infdata, h->data * sizeof(cfix_uint_t));
 			return true;
 		}
 	}
 #else
-	assert(key < CFIX_INF);
+	assert(ticket->key < CFIX_INF);
 #endif
 
-	if (!cfix_locate(h, key, &base, &offset, &__unused)) return false;
-	cfix_data_retrieve(h, base, offset, data);
-	return true;
+	if (cfix_bin_locate(h, ticket->base_full, ticket->key, &offset)) {
+		cfix_data_retrieve(h, ticket->base_full, offset, data);
+		return true;
+	}
+	if (cfix_bin_locate(h, ticket->base_half, ticket->key, &offset)) {
+		cfix_data_retrieve(h, ticket->base_half, offset, data);
+		return true;
+	}
+	if (cfix_mig_view(h, &mig) && cfix_locate(&mig, ticket->key, &base, &offset, &__unused)) {
+		cfix_data_retrieve(&mig, base, offset, data);
+		return true;
+	}
+	return false;
 }
 
 	bool
-cfix_update(cfix_t *h, uint32_t key, uint32_t *data)
+cfix_update(cfix_t *h, cfix_uint_t key, cfix_uint_t *data)
 {
-	uint32_t base, offset, *__unused;
+	cfix_t mig;
+	uint32_t base, offset;
+	cfix_uint_t *__unused;
+
+	assert(!h->frozen);
 
 #ifdef CFIX_INFDATA
 	if (key == CFIX_INF) {
 		if (h->infdata == NULL) {
 			return false;
 		} else {
-			memcpy(h->infdata, data, (h->size - 1) * sizeof(uint32_t));
+			cfix_write_begin(h);
+			memcpy(h->infdata, data, h->data * sizeof(cfix_uint_t));
+			cfix_write_end(h);
 			return true;
 		}
 	}
@@ -997,28 +3165,45 @@ cfix_update(cfix_t *h, uint32_t key, uint32_t *data)
 	assert(key < CFIX_INF);
 #endif
 
-	if (!cfix_locate(h, key, &base, &offset, &__unused)) return false;
-	cfix_data_store(h, data, base, offset);
-	++h->version;
-	return true;
+	if (h->mig_bin != NULL) {
+		cfix_write_begin(h);
+		cfix_migrate_step(h, h->migrate);
+		cfix_write_end(h);
+	}
+
+	if (cfix_locate(h, key, &base, &offset, &__unused)) {
+		cfix_write_begin(h);
+		cfix_data_write(h, data, base, offset);
+		cfix_write_end(h);
+		return true;
+	}
+	if (cfix_mig_view(h, &mig) && cfix_locate(&mig, key, &base, &offset, &__unused)) {
+		cfix_write_begin(h);
+		cfix_data_write(&mig, data, base, offset);
+		cfix_write_end(h);
+		return true;
+	}
+	return false;
 }
 
 	void
 cfix_apply(
 		cfix_t *h,
-		void(*fun)(uint32_t, uint32_t *, void *),
+		void(*fun)(cfix_uint_t, cfix_uint_t *, void *),
 		void *aux)
 {
 	uint64_t version;
 	uint32_t base, offset;
 
+	cfix_migrate_finish(h);
+
 	version = h->version;
 	for (base = 0; base < h->bins; base++) {
 		for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
-			uint32_t key = CFIX_KEY(h, base, offset);
+			cfix_uint_t key = CFIX_KEY(h, base, offset);
 
 			if (key	== CFIX_INF) break;
-			fun(key, CFIX_DATA(h, base, offset), aux);
+			fun(key, cfix_data_ptr(h, base, offset), aux);
 			if (version != h->version) {
 				fprintf(stderr, "\n\nFATAL ERROR in \"cfix_apply\" - function call compromised CFIX instance!\n");
 				exit(1);
@@ -1030,6 +3215,93 @@ cfix_apply(
 		fun(CFIX_INF, h->infdata, aux);
 	}
 #endif
+}
+
+/** @brief Per-worker argument block for cfix_apply_par. */
+struct cfix_apply_par_arg {
+	cfix_t *h;			/*< Instance being scanned. */
+	uint64_t version;	/*< Version captured before the scan started. */
+	uint32_t from;		/*< First bin of the worker's range. */
+	uint32_t to;		/*< One past the last bin of the worker's range. */
+	void (*fun)(cfix_uint_t, cfix_uint_t *, void *);	/*< Call-back function. */
+	void *aux;			/*< Auxiliary pointer passed to the call-back. */
+};
+
+	static void *
+cfix_apply_par_worker(void *p)
+{
+	struct cfix_apply_par_arg *arg = (struct cfix_apply_par_arg *)p;
+	cfix_t *h = arg->h;
+	uint32_t base, offset;
+
+	for (base = arg->from; base < arg->to; base++) {
+		for (offset = 0; offset < CFIX_BIN_SIZE; offset++) {
+			cfix_uint_t key = CFIX_KEY(h, base, offset);
+
+			if (key	== CFIX_INF) break;
+			arg->fun(key, cfix_data_ptr(h, base, offset), arg->aux);
+			if (arg->version != h->version) {
+				fprintf(stderr, "\n\nFATAL ERROR in \"cfix_apply_par\" - function call compromised CFIX instance!\n");
+				exit(1);
+			}
+		}
+	}
+	return NULL;
+}
+
+	void
+cfix_apply_par(
+		cfix_t *h,
+		void(*fun)(cfix_uint_t, cfix_uint_t *, void *),
+		void *aux,
+		uint32_t nthreads)
+{
+	struct cfix_apply_par_arg arg[CFIX_APPLY_PAR_MAX];
+	pthread_t thread[CFIX_APPLY_PAR_MAX];
+	uint32_t i, from, share, extra;
+
+	cfix_migrate_finish(h);
+
+	if (nthreads > CFIX_APPLY_PAR_MAX) nthreads = CFIX_APPLY_PAR_MAX;
+	if (nthreads > h->bins) nthreads = h->bins;
+	if (nthreads < 2) {
+		cfix_apply(h, fun, aux);
+		return;
+	}
+
+	/*
+	 * Split the bin range evenly - bins are evenly loaded by construction so
+	 * equal ranges give equal work.  The first extra workers absorb the
+	 * remainder one bin each.
+	 */
+	share = h->bins / nthreads;
+	extra = h->bins % nthreads;
+	from = 0;
+	for (i = 0; i < nthreads; i++) {
+		arg[i].h = h;
+		arg[i].version = h->version;
+		arg[i].from = from;
+		from += share + (i < extra ? 1 : 0);
+		arg[i].to = from;
+		arg[i].fun = fun;
+		arg[i].aux = aux;
+	}
+	assert(from == h->bins);
+
+	for (i = 1; i < nthreads; i++) {
+		assert(pthread_create(&thread[i], NULL, cfix_apply_par_worker, &arg[i]) == 0);
+	}
+	/* The calling thread works the first range instead of idling. */
+	cfix_apply_par_worker(&arg[0]);
+	for (i = 1; i < nthreads; i++) {
+		assert(pthread_join(thread[i], NULL) == 0);
+	}
+
+#ifdef CFIX_INFDATA
+	if (h->infdata != NULL) {
+		fun(CFIX_INF, h->infdata, aux);
+	}
+#endif
 }
 
 	void
@@ -1058,6 +3330,8 @@ cfix_iter_reset(
 {
 	assert(h == iter->h);
 
+	cfix_migrate_finish(h);
+
 	iter->version = h->version;
 	iter->base = iter->offset = 0;
 	if (h->keys == 0) return;
@@ -1069,8 +3343,8 @@ cfix_iter_reset(
 cfix_iter_current(
 		cfix_t *h,
 		cfix_iter_t *iter,
-		uint32_t *key,
-		uint32_t *data)
+		cfix_uint_t *key,
+		cfix_uint_t *data)
 {
 	assert(h == iter->h);
 
@@ -1080,7 +3354,7 @@ cfix_iter_current(
 	if (iter->base == h->bins) {
 		if (iter->offset == 0 && h->infdata != NULL) {
 			(*key) = CFIX_INF;
-			memcpy(data, h->infdata, (h->size - 1) * sizeof(uint32_t));
+			memcpy(data, h->infdata, h->data * sizeof(cfix_uint_t));
 			return CFIX_ITER_SUCCESS;
 		}
 		return CFIX_ITER_FAILURE;
@@ -1134,18 +3408,19 @@ cfix_iter_forward(
 	void
 cfix_stats(cfix_t *h, cfix_stats_t *stats)
 {
-	static uint32_t i, b, o;
+	uint32_t i;
 
-	stats->primary = 0;
-	for (i = 0; i < CFIX_BIN_SIZE + 1; i++) stats->hist[i] = 0;
+	cfix_migrate_finish(h);
 
-	for (b = 0; b < h->bins; b++) {
-		++stats->hist[cfix_bin_count(h, b)];
-		for (o = 0; o < CFIX_BIN_SIZE; o++) {
-			uint32_t key = CFIX_KEY(h, b, o);
+	stats->locate_primary = h->count.locate_primary;
+	stats->locate_secondary = h->count.locate_secondary;
+	for (i = 0; i < CFIX_CHAIN_HIST; i++) stats->chain[i] = h->count.chain[i];
+	stats->grows = h->count.grows;
+	stats->shrinks = h->count.shrinks;
+	stats->rebuilds = h->count.rebuilds;
+	stats->moved = h->count.moved;
+	stats->retries = h->count.retries;
 
-			if (key == CFIX_INF) break;
-			if (b == (cfix_full_avalanche(key) % h->bins)) ++stats->primary;
-		}
-	}
+	stats->primary = h->count.primary;
+	for (i = 0; i < CFIX_BIN_SIZE + 1; i++) stats->hist[i] = h->count.hist[i];
 }
@@ -44,6 +44,9 @@
 /** @brief Minimum compression ratio supported. */
 #define CFIX_RATIO_MIN ((double)0.01)
 
+/** @brief Number of keys hashed and prefetched ahead of resolution in batched lookup. */
+#define CFIX_BATCH 64
+
 /** @brief Configuration default values. If you don't know what you are doing, use these (in particular the last three :). */
 #define CFIX_CONFIG_DEFAULT_START		112
 #define CFIX_CONFIG_DEFAULT_DATA		1
@@ -53,6 +56,9 @@
 #define CFIX_CONFIG_DEFAULT_GROWTH	1.5
 #define CFIX_CONFIG_DEFAULT_ATTEMPT	0.5
 #define CFIX_CONFIG_DEFAULT_RANDOM	0.5
+#define CFIX_CONFIG_DEFAULT_MIGRATE	0
+#define CFIX_CONFIG_DEFAULT_PTWO		0
+#define CFIX_CONFIG_DEFAULT_INDIRECT	0
 
 /**
  * @brief CFIX abstract data type.
@@ -72,18 +78,47 @@ struct cfix_config {
 	double growth;	/*< Base growth factor for increasing primes index and number of bins when insertion fails - controls level of expansion in bin increase. */
 	double attempt;	/*< Attempt factor when increasing prime index when bin increase fails - controls level of increase for next attempt when bin increase fails. */
 	double random;	/*< Random factor used to compute prime index and bin increase - controls level of randomness in bin increase. */
+	uint32_t migrate;	/*< Number of old bins migrated per update operation during incremental resize - zero (the default) selects stop-the-world rehash. */
+	uint32_t ptwo;		/*< Non-zero selects power-of-two bin counts instead of the prime ladder - growth becomes an exact doubling. */
+	uint32_t indirect;	/*< Non-zero stores data out of line in a per-instance slab - bins hold keys plus a one-word handle, so cuckoo relocation and bin rolls move one word regardless of data size and the key line stays maximally dense.  Ignored when data is zero. */
 };
 typedef struct cfix_config cfix_config_t;
 
+/** @brief Number of buckets in the cuckoo chain length histogram - the last bucket collects longer chains. */
+#define CFIX_CHAIN_HIST 8
+
 /**
  * @brief CFIX statistics data type used to collect statistics not available by other means.
+ *
+ * The operation counters are maintained as simple increments on the hot paths
+ * and accumulate from creation - poll twice and subtract to get rates.
+ * Probes that resolve in the old array of an in-flight incremental resize are
+ * not counted.
  */
 struct cfix_stats {
 	uint32_t hist[CFIX_BIN_SIZE + 1];	/*< Histogram of number of bins and number of keys in bin. */
-	uint32_t primary;					/*< Number of keys stored in primary location. */ 
+	uint32_t primary;					/*< Number of keys stored in primary location. */
+	uint64_t locate_primary;			/*< Successful probes resolved in the primary bin. */
+	uint64_t locate_secondary;			/*< Successful probes resolved in the secondary bin. */
+	uint64_t chain[CFIX_CHAIN_HIST];	/*< Histogram of cuckoo relocation chain lengths over successful insertions. */
+	uint64_t grows;						/*< Number of growth events, incremental resizes included. */
+	uint64_t shrinks;					/*< Number of shrink events. */
+	uint64_t rebuilds;					/*< Number of rebuilds (cfix_rebuild and cfix_reserve). */
+	uint64_t moved;						/*< Keys reinserted by resize events - scrapped attempts included. */
+	uint64_t retries;					/*< Scrapped arrays in resize retry loops. */
 };
 typedef struct cfix_stats cfix_stats_t;
 
+/**
+ * @brief CFIX lookup ticket data type carrying state from cfix_lookup_prepare to cfix_lookup_finish.
+ */
+struct cfix_ticket {
+	uint32_t key;		/*< Key being looked up. */
+	uint32_t base_full;	/*< Primary candidate bin computed from full avalanche hash. */
+	uint32_t base_half;	/*< Secondary candidate bin computed from half avalanche hash. */
+};
+typedef struct cfix_ticket cfix_ticket_t;
+
 /**
  * @brief CFIX iterator data type.
  */
@@ -119,12 +154,32 @@ void cfix_destroy(cfix_t **h);
 /**
  * @brief Clone CFIX instance.
  *
+ * The bin array is shared with the original copy-on-write - cloning is O(1)
+ * and the first update of either instance pays for the copy.
+ *
  * @param h CFIX instance to clone.
- * 
+ *
  * @return Cloned CFIX instance.
- */ 
+ */
 cfix_t *cfix_clone(cfix_t *h);
 
+/**
+ * @brief Take a point-in-time snapshot of a CFIX instance.
+ *
+ * The snapshot shares the bin array with the original copy-on-write, so
+ * taking it is O(1) and updates to the original proceed untouched against a
+ * private copy. Iterators created on the snapshot are bound to it and never
+ * become invalid, since the snapshot itself is never updated - use this for
+ * consistent scans while the original keeps changing. Release the snapshot
+ * with cfix_destroy. Updating a snapshot works but makes it an ordinary
+ * clone.
+ *
+ * @param h CFIX instance to snapshot.
+ *
+ * @return Snapshot CFIX instance.
+ */
+cfix_t *cfix_snapshot(cfix_t *h);
+
 /**
  * @brief Insert (key, data) pair in CFIX instance.
  *
@@ -138,6 +193,53 @@ cfix_t *cfix_clone(cfix_t *h);
  */
 bool cfix_insert(cfix_t *h, uint32_t key, uint32_t *data);
 
+/**
+ * @brief Insert n (key, data) pairs in CFIX instance in one pass.
+ *
+ * The table is dimensioned once for all n keys up front and the keys are
+ * inserted in target bin order, so loading a large batch avoids the repeated
+ * rehashing and random access of per-key insertion.
+ *
+ * @param h CFIX instance to perform insertion in.
+ * @param keys Array of n keys to insert.
+ * @param data Location of n data records, laid out back to back - ignored if
+ * CFIX instance data size is zero.
+ * @param n Number of (key, data) pairs to insert.
+ *
+ * @return Boolean true if all n keys were inserted and false if any key was
+ * already present (the remaining keys are still inserted).
+ */
+bool cfix_insert_bulk(cfix_t *h, uint32_t *keys, uint32_t *data, uint32_t n);
+
+/**
+ * @brief Merge every (key, data) pair of one CFIX instance into another.
+ *
+ * dst is dimensioned once up front and src's bin array is streamed
+ * sequentially, with the physical pages behind consumed bins handed back as
+ * the merge advances, so consolidating sharded tables avoids the repeated
+ * growth and random probing of per-key insertion. Keys already present in
+ * dst keep their data and the src pair is dropped. src is left empty but
+ * valid on return. Both instances must have the same data size.
+ *
+ * @param dst CFIX instance to merge into.
+ * @param src CFIX instance to drain.
+ *
+ * @return Number of pairs merged into dst.
+ */
+uint32_t cfix_merge(cfix_t *dst, cfix_t *src);
+
+/**
+ * @brief Reserve capacity for n keys in CFIX instance.
+ *
+ * Grows the table, if necessary, until n keys fit within the configured
+ * upper threshold - subsequent insertions up to n keys then proceed without
+ * rehashing.  A table already large enough is left untouched.
+ *
+ * @param h CFIX instance to reserve capacity in.
+ * @param n Total number of keys to make room for, including keys present.
+ */
+void cfix_reserve(cfix_t *h, uint32_t n);
+
 /**
  * @brief Delete key and associated data from CFIX instance.
  *
@@ -161,6 +263,81 @@ bool cfix_delete(cfix_t *h, uint32_t key);
  */
 bool cfix_lookup(cfix_t *h, uint32_t key, uint32_t *data);
 
+/**
+ * @brief Lookup data associated with key, safe against a single concurrent writer.
+ *
+ * Seqlock-style retrying reader for builds with CFIX_SEQLOCK enabled in
+ * cfix.c: the version counter is sampled before and after the probe and the
+ * probe is redone if a mutation was in flight.  Without CFIX_SEQLOCK this is
+ * plain cfix_lookup.
+ *
+ * @param h CFIX instance to perform lookup in.
+ * @param key Key to lookup - key must be smaller than cfix_key_lim.
+ * @param data Location where looked up data is stored on successful lookup.
+ *
+ * @return Boolean true on success and false otherwise (e.g. key missing).
+ *
+ * @note Supports one writer thread and any number of reader threads - multiple writers still require external locking.
+ */
+bool cfix_lookup_seq(cfix_t *h, uint32_t key, uint32_t *data);
+
+/**
+ * @brief Reclaim bin arrays retired by growth, shrink and rebuild.
+ *
+ * With CFIX_SEQLOCK enabled, replaced bin arrays are parked instead of freed
+ * since concurrent readers may still be probing them.  The writer should
+ * call this when it knows no reader is mid-lookup (e.g. between batches).
+ * Without CFIX_SEQLOCK arrays are freed eagerly and this is a no-op.
+ *
+ * @param h CFIX instance.
+ */
+void cfix_reclaim(cfix_t *h);
+
+/**
+ * @brief Lookup data associated with a batch of keys in CFIX instance.
+ *
+ * Hashes all keys up front and prefetches both candidate bins of every key
+ * before resolving any of them, thus overlapping the memory accesses that a
+ * sequence of cfix_lookup calls would serialize.
+ *
+ * @param h CFIX instance to perform lookups in.
+ * @param keys Array of n keys to lookup.
+ * @param data Location where looked up data is stored, (data size) uint32_t's per key, or NULL if data size is zero.
+ * @param results Location where per-key lookup outcome is stored.
+ * @param n Number of keys to lookup.
+ *
+ * @return Boolean true if all n keys were found and false otherwise.
+ *
+ * @note Keys are processed in chunks of (at most) CFIX_BATCH keys at a time.
+ */
+bool cfix_lookup_batch(cfix_t *h, const uint32_t *keys, uint32_t *data, bool *results, size_t n);
+
+/**
+ * @brief First half of a two-phase lookup - hash key and prefetch both candidate bins.
+ *
+ * Allows the caller to interleave other work (or further prepare calls) with
+ * the memory accesses of the probe instead of blocking on them, even when
+ * keys arrive one at a time rather than in batches.
+ *
+ * @param h CFIX instance to perform lookup in.
+ * @param key Key to lookup - key must be smaller than cfix_key_lim.
+ * @param ticket Location where lookup state is stored for cfix_lookup_finish.
+ *
+ * @note The ticket is invalidated by any update operation on the instance.
+ */
+void cfix_lookup_prepare(cfix_t *h, uint32_t key, cfix_ticket_t *ticket);
+
+/**
+ * @brief Second half of a two-phase lookup - resolve a probe started by cfix_lookup_prepare.
+ *
+ * @param h CFIX instance to perform lookup in.
+ * @param ticket Lookup state produced by cfix_lookup_prepare.
+ * @param data Location where looked up data is stored on successful lookup.
+ *
+ * @return Boolean true on success and false otherwise (e.g. key missing).
+ */
+bool cfix_lookup_finish(cfix_t *h, cfix_ticket_t *ticket, uint32_t *data);
+
 /**
  * @brief Update data associated with key in CFIX instance.
  *
@@ -214,6 +391,39 @@ uint32_t cfix_keys(cfix_t *h);
  */
 uint32_t cfix_bins(cfix_t *h);
 
+/**
+ * @brief Migrate up to budget bins of a pending incremental resize.
+ *
+ * With a non-zero migrate configuration, growth keeps the old bin array live
+ * and every update operation moves a bounded number of old bins to the new
+ * array, so no single insert pays for a full rehash.  This call lets the
+ * application burn additional migration budget at a moment of its choosing
+ * (e.g. idle time).
+ *
+ * @param h CFIX instance.
+ * @param budget Maximum number of old bins to migrate - 0 migrates all remaining bins.
+ *
+ * @return Boolean true if a migration is still in progress afterwards and false otherwise.
+ */
+bool cfix_migrate(cfix_t *h, uint32_t budget);
+
+/**
+ * @brief Perform up to budget bins of deferred maintenance work.
+ *
+ * With a non-zero migrate configuration, cfix_delete no longer shrinks the
+ * table inline when fill drops below lower - it only marks the table
+ * shrink-pending, so no single delete pays for re-inserting every key.
+ * This call, meant to be issued from application idle time (or a dedicated
+ * maintenance thread in single-writer setups), starts the pending shrink
+ * migration and advances it like cfix_migrate.
+ *
+ * @param h CFIX instance.
+ * @param budget Maximum number of old bins to migrate - 0 completes all pending work.
+ *
+ * @return Boolean true if maintenance work remains afterwards and false otherwise.
+ */
+bool cfix_maintain(cfix_t *h, uint32_t budget);
+
 /**
  * @brief Rebuild the hash table w r t a target fill ratio.
  *
@@ -224,6 +434,34 @@ uint32_t cfix_bins(cfix_t *h);
  */
 void cfix_rebuild(cfix_t *h, double ratio);
 
+/**
+ * @brief Save snapshot of CFIX instance to file.
+ *
+ * The snapshot is a small header followed by the raw bin array, so saving is
+ * a single sequential write and loading is O(file open).
+ *
+ * @param h CFIX instance to save.
+ * @param path Snapshot file path.
+ *
+ * @return Boolean true on success and false otherwise (e.g. file not writable).
+ */
+bool cfix_save(cfix_t *h, const char *path);
+
+/**
+ * @brief Create CFIX instance from snapshot file.
+ *
+ * The bin array is memory mapped MAP_PRIVATE and adopted zero-copy - pages
+ * are faulted in on demand and copied on first write, so cold start does not
+ * pay for O(n) re-insertion.  The instance supports the full API including
+ * updates; the snapshot file itself is never modified.
+ *
+ * @param h Location to store new CFIX instance.
+ * @param path Snapshot file path.
+ *
+ * @return Boolean true on success and false otherwise (e.g. bad magic or truncated file).
+ */
+bool cfix_load(cfix_t **h, const char *path);
+
 /**
  * @brief Generate statistics.
  *
@@ -240,6 +478,65 @@ void cfix_stats(cfix_t *h, cfix_stats_t *stats);
  */
 void cfix_apply(cfix_t *h, void(*fun)(uint32_t, uint32_t *, void *), void *aux);
 
+/**
+ * @brief Apply call-back function on all (key, data)-pairs in CFIX instance using multiple threads.
+ *
+ * The bin range is split evenly over nthreads workers (the calling thread
+ * included), so the call-back runs concurrently and must be thread-safe.
+ * Like cfix_apply the call-back must not update the instance - doing so
+ * terminates the program. Ordering of pairs between workers is unspecified.
+ * The pair associated with infinity, when present, is delivered last from
+ * the calling thread.
+ *
+ * @param h CFIX instance.
+ * @param fun Call-back function where the arguments are key, data and auxiliary pointer in that order.
+ * @param aux Auxiliary pointer passed to call-back function.
+ * @param nthreads Number of threads to scan with - values below 2 select the sequential cfix_apply.
+ */
+void cfix_apply_par(cfix_t *h, void(*fun)(uint32_t, uint32_t *, void *), void *aux, uint32_t nthreads);
+
+/**
+ * @brief Rebuild CFIX instance using multiple threads.
+ *
+ * Same contract as cfix_rebuild, rehashed in parallel: workers scan
+ * disjoint old-bin ranges and partition the entries by destination bin
+ * range, then insert into disjoint destination ranges without locking. The
+ * few entries whose bins straddle range boundaries are re-inserted
+ * sequentially at the end through the ordinary cuckoo path. Concurrent
+ * readers are only supported with CFIX_SEQLOCK, exactly as for the
+ * sequential rebuild.
+ *
+ * @param h CFIX instance to rebuild.
+ * @param ratio Target fill ratio.
+ * @param nthreads Number of worker threads - values below 2 select the sequential cfix_rebuild.
+ */
+void cfix_rebuild_par(cfix_t *h, double ratio, uint32_t nthreads);
+
+/**
+ * @brief Freeze CFIX instance into a read-only serving table.
+ *
+ * Finishes any incremental resize, then repacks into the fewest bins that
+ * can hold the present keys - failed attempts are scrapped and retried one
+ * prime up instead of applying the growth factors, so the result is the
+ * tightest fit the cuckoo scheme admits - and marks the instance frozen.
+ * Lookups, iteration, apply, save and snapshots remain available; all
+ * mutating operations assert against a frozen instance.  The frozen mark
+ * survives cfix_save/cfix_load, so a frozen snapshot file doubles as a
+ * read-only replica artifact served straight from the mapping.
+ *
+ * @param h CFIX instance to freeze - freezing a frozen instance is a no-op.
+ */
+void cfix_freeze(cfix_t *h);
+
+/**
+ * @brief Report whether a CFIX instance has been frozen - see cfix_freeze.
+ *
+ * @param h CFIX instance.
+ *
+ * @return Boolean true if the instance is frozen and false otherwise.
+ */
+bool cfix_frozen(cfix_t *h);
+
 /**
  * @brief Create and reset iterator.
  *
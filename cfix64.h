@@ -0,0 +1,195 @@
+/**
+ * @file cfix64.h
+ * @brief Hash table for 64-bit entries, i.e. (key, data) pairs.
+ * @author Mikael Sundstrom <micke@fabinv.com>
+ *
+ * @copyright Copyright (c) 2018 Fabulous Inventions AB - all rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef CFIX64
+#define CFIX64
+
+/*
+ * 64-bit key build of cfix, compiled from the same source (see cfix64.c and
+ * CFIX_KEY64 in cfix.c).  Keys and data words are uint64_t, a bin holds 8
+ * sorted keys instead of 16 and the sentinel is the all-ones 64-bit value -
+ * everything else, including the configuration, the iterator protocol and
+ * the compile switches in cfix.c, is exactly the 32-bit table.  Shared
+ * constants and types (cfix_config_t, cfix_iter_status_t, defaults) come
+ * from cfix.h; the per-function contracts below are those of the cfix_*
+ * counterparts documented there, with uint32_t keys and data words read as
+ * uint64_t.
+ */
+#include "cfix.h"
+
+/** @brief Size of each key in bytes. */
+#define CFIX64_KEY_SIZE sizeof(uint64_t)
+
+/** @brief Number of entries per bin - still one 64-byte cache line. */
+#define CFIX64_BIN_SIZE (M2_ALIGNMENT / CFIX64_KEY_SIZE)
+
+/**
+ * @brief CFIX64 abstract data type.
+ */
+struct cfix64;
+typedef struct cfix64 cfix64_t;
+
+/**
+ * @brief CFIX64 statistics data type - see struct cfix_stats in cfix.h.
+ */
+struct cfix64_stats {
+	uint32_t hist[CFIX64_BIN_SIZE + 1];	/*< Histogram of number of bins and number of keys in bin. */
+	uint32_t primary;					/*< Number of keys stored in primary location. */
+	uint64_t locate_primary;			/*< Successful probes resolved in the primary bin. */
+	uint64_t locate_secondary;			/*< Successful probes resolved in the secondary bin. */
+	uint64_t chain[CFIX_CHAIN_HIST];	/*< Histogram of cuckoo relocation chain lengths over successful insertions. */
+	uint64_t grows;						/*< Number of growth events, incremental resizes included. */
+	uint64_t shrinks;					/*< Number of shrink events. */
+	uint64_t rebuilds;					/*< Number of rebuilds (cfix64_rebuild and cfix64_reserve). */
+	uint64_t moved;						/*< Keys reinserted by resize events - scrapped attempts included. */
+	uint64_t retries;					/*< Scrapped arrays in resize retry loops. */
+};
+typedef struct cfix64_stats cfix64_stats_t;
+
+/**
+ * @brief CFIX64 lookup ticket data type carrying state from cfix64_lookup_prepare to cfix64_lookup_finish.
+ */
+struct cfix64_ticket {
+	uint64_t key;		/*< Key being looked up. */
+	uint32_t base_full;	/*< Primary candidate bin computed from full avalanche hash. */
+	uint32_t base_half;	/*< Secondary candidate bin computed from half avalanche hash. */
+};
+typedef struct cfix64_ticket cfix64_ticket_t;
+
+/**
+ * @brief CFIX64 iterator data type.
+ */
+struct cfix64_iter;
+typedef struct cfix64_iter cfix64_iter_t;
+
+/** @brief Create new hash table instance - see cfix_create. */
+void cfix64_create(cfix64_t **h, cfix_config_t *conf);
+
+/** @brief Destroy existing CFIX64 instance - see cfix_destroy. */
+void cfix64_destroy(cfix64_t **h);
+
+/** @brief Clone CFIX64 instance copy-on-write - see cfix_clone. */
+cfix64_t *cfix64_clone(cfix64_t *h);
+
+/** @brief Take a point-in-time snapshot of a CFIX64 instance - see cfix_snapshot. */
+cfix64_t *cfix64_snapshot(cfix64_t *h);
+
+/** @brief Insert (key, data) pair in CFIX64 instance - see cfix_insert. */
+bool cfix64_insert(cfix64_t *h, uint64_t key, uint64_t *data);
+
+/** @brief Insert n (key, data) pairs in CFIX64 instance in one pass - see cfix_insert_bulk. */
+bool cfix64_insert_bulk(cfix64_t *h, uint64_t *keys, uint64_t *data, uint32_t n);
+
+/** @brief Merge every (key, data) pair of one CFIX64 instance into another - see cfix_merge. */
+uint32_t cfix64_merge(cfix64_t *dst, cfix64_t *src);
+
+/** @brief Reserve capacity for n keys in CFIX64 instance - see cfix_reserve. */
+void cfix64_reserve(cfix64_t *h, uint32_t n);
+
+/** @brief Delete key and associated data from CFIX64 instance - see cfix_delete. */
+bool cfix64_delete(cfix64_t *h, uint64_t key);
+
+/** @brief Lookup data associated with key in CFIX64 instance - see cfix_lookup. */
+bool cfix64_lookup(cfix64_t *h, uint64_t key, uint64_t *data);
+
+/** @brief Lookup safe against a single concurrent writer - see cfix_lookup_seq. */
+bool cfix64_lookup_seq(cfix64_t *h, uint64_t key, uint64_t *data);
+
+/** @brief Reclaim bin arrays retired by growth, shrink and rebuild - see cfix_reclaim. */
+void cfix64_reclaim(cfix64_t *h);
+
+/** @brief Lookup data associated with a batch of keys - see cfix_lookup_batch. */
+bool cfix64_lookup_batch(cfix64_t *h, const uint64_t *keys, uint64_t *data, bool *results, size_t n);
+
+/** @brief First half of a two-phase lookup - see cfix_lookup_prepare. */
+void cfix64_lookup_prepare(cfix64_t *h, uint64_t key, cfix64_ticket_t *ticket);
+
+/** @brief Second half of a two-phase lookup - see cfix_lookup_finish. */
+bool cfix64_lookup_finish(cfix64_t *h, cfix64_ticket_t *ticket, uint64_t *data);
+
+/** @brief Update data associated with key in CFIX64 instance - see cfix_update. */
+bool cfix64_update(cfix64_t *h, uint64_t key, uint64_t *data);
+
+/** @brief Return the smallest key present since the last reconstruction - see cfix_min. */
+uint64_t cfix64_min(cfix64_t *h);
+
+/** @brief Return the largest key present since the last reconstruction - see cfix_max. */
+uint64_t cfix64_max(cfix64_t *h);
+
+/** @brief Return current number of keys in the hash table - see cfix_keys. */
+uint32_t cfix64_keys(cfix64_t *h);
+
+/** @brief Return current number of bins - see cfix_bins. */
+uint32_t cfix64_bins(cfix64_t *h);
+
+/** @brief Migrate up to budget bins of a pending incremental resize - see cfix_migrate. */
+bool cfix64_migrate(cfix64_t *h, uint32_t budget);
+
+/** @brief Perform up to budget bins of deferred maintenance work - see cfix_maintain. */
+bool cfix64_maintain(cfix64_t *h, uint32_t budget);
+
+/** @brief Rebuild the hash table w r t a target fill ratio - see cfix_rebuild. */
+void cfix64_rebuild(cfix64_t *h, double ratio);
+
+/** @brief Save snapshot of CFIX64 instance to file - see cfix_save.  The file format is distinct from the 32-bit format and the two never cross-load. */
+bool cfix64_save(cfix64_t *h, const char *path);
+
+/** @brief Create CFIX64 instance from snapshot file - see cfix_load. */
+bool cfix64_load(cfix64_t **h, const char *path);
+
+/** @brief Generate statistics - see cfix_stats. */
+void cfix64_stats(cfix64_t *h, cfix64_stats_t *stats);
+
+/** @brief Apply call-back function on all (key, data)-pairs - see cfix_apply. */
+void cfix64_apply(cfix64_t *h, void(*fun)(uint64_t, uint64_t *, void *), void *aux);
+
+/** @brief Apply call-back function on all (key, data)-pairs using multiple threads - see cfix_apply_par. */
+void cfix64_apply_par(cfix64_t *h, void(*fun)(uint64_t, uint64_t *, void *), void *aux, uint32_t nthreads);
+
+/** @brief Rebuild CFIX64 instance using multiple threads - see cfix_rebuild_par. */
+void cfix64_rebuild_par(cfix64_t *h, double ratio, uint32_t nthreads);
+
+/** @brief Freeze CFIX64 instance into a read-only serving table - see cfix_freeze. */
+void cfix64_freeze(cfix64_t *h);
+
+/** @brief Report whether a CFIX64 instance has been frozen - see cfix_freeze. */
+bool cfix64_frozen(cfix64_t *h);
+
+/** @brief Create and reset iterator - see cfix_iter_create. */
+void cfix64_iter_create(cfix64_t *h, cfix64_iter_t **iter);
+
+/** @brief Destroy iterator - see cfix_iter_destroy. */
+void cfix64_iter_destroy(cfix64_iter_t **iter);
+
+/** @brief Reset iterator - see cfix_iter_reset. */
+void cfix64_iter_reset(cfix64_t *h, cfix64_iter_t *iter);
+
+/** @brief Retrieve current (key, data)-pair - see cfix_iter_current. */
+cfix_iter_status_t cfix64_iter_current(cfix64_t *h, cfix64_iter_t *iter, uint64_t *key, uint64_t *data);
+
+/** @brief Move iterator to the next (key, data) pair if possible - see cfix_iter_forward. */
+cfix_iter_status_t cfix64_iter_forward(cfix64_t *h, cfix64_iter_t *iter);
+
+#endif /* CFIX64 */
@@ -0,0 +1,424 @@
+/**
+ * @file cfix_bench.c
+ * @brief Benchmark program for hash table for 32-bit entries, i.e. (key, data) pairs.
+ * @author Mikael Sundstrom <micke@fabinv.com>
+ *
+ * @copyright Copyright (c) 2018 Fabulous Inventions AB - all rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "cfix.h"
+
+/*
+ * Replaces the hardcoded driver in cfix_main.c for performance work - table
+ * size, data size, operation mix and key distribution are selected on the
+ * command line, per-operation latencies are reported as percentiles rather
+ * than means, and results come out as one CSV row per phase on stdout so two
+ * builds can be compared mechanically.
+ */
+
+enum bench_gen {
+	BENCH_GEN_UNIFORM,	/*< Keys drawn uniformly from the key space. */
+	BENCH_GEN_ZIPF,		/*< Keys drawn from a Zipfian distribution over the key space. */
+	BENCH_GEN_SEQ		/*< Keys drawn sequentially from the key space. */
+};
+
+/*
+ * Zipfian generator state - the usual incremental formulation (Gray et al.),
+ * with ranks scrambled over the key space so hot keys do not share bins.
+ */
+struct bench_zipf {
+	uint32_t n;		/*< Size of the key space. */
+	double theta;	/*< Skew - 0 is uniform, 0.99 is the customary hot-key mix. */
+	double alpha;	/*< 1 / (1 - theta). */
+	double zetan;	/*< Generalized harmonic number of order theta for n. */
+	double eta;		/*< Scaling constant derived from theta and zetan. */
+};
+
+struct bench {
+	enum bench_gen gen;		/*< Key generator. */
+	struct bench_zipf zipf;	/*< Zipfian state - valid when gen is BENCH_GEN_ZIPF. */
+	uint32_t space;			/*< Size of the key space. */
+	uint32_t seq;			/*< Next key - used when gen is BENCH_GEN_SEQ. */
+};
+
+#define BENCH_PERF_EVENTS 4
+
+/*
+ * Hardware counters wrapped around each phase when -p is given - answers the
+ * questions wall-clock timing cannot: cache lines touched per cuckoo chain,
+ * mispredicts in the bin search, TLB behaviour of the bin array.
+ */
+struct bench_perf {
+	int fd[BENCH_PERF_EVENTS];			/*< One perf event descriptor per counter, -1 when unavailable. */
+	uint64_t count[BENCH_PERF_EVENTS];	/*< Counter values collected by bench_perf_stop. */
+	bool enabled;						/*< True when counting was requested and at least one counter opened. */
+};
+
+static const struct {
+	uint32_t type;		/*< Event type (see perf_event_open). */
+	uint64_t config;	/*< Type-specific event selector. */
+	const char *name;	/*< CSV column name. */
+} bench_perf_event[BENCH_PERF_EVENTS] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+	{ PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_LL |
+		(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "llc_miss" },
+	{ PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_DTLB |
+		(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16), "dtlb_miss" },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "br_miss" },
+};
+
+	static void
+bench_perf_open(struct bench_perf *p)
+{
+	struct perf_event_attr attr;
+	uint32_t e;
+
+	p->enabled = false;
+	for (e = 0; e < BENCH_PERF_EVENTS; e++) {
+		memset(&attr, 0, sizeof(attr));
+		attr.type = bench_perf_event[e].type;
+		attr.size = sizeof(attr);
+		attr.config = bench_perf_event[e].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		p->fd[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (p->fd[e] >= 0) p->enabled = true;
+		else fprintf(stderr, "cfix_bench: %s counter unavailable\n", bench_perf_event[e].name);
+	}
+}
+
+	static void
+bench_perf_start(struct bench_perf *p)
+{
+	uint32_t e;
+
+	if (!p->enabled) return;
+	for (e = 0; e < BENCH_PERF_EVENTS; e++) {
+		if (p->fd[e] < 0) continue;
+		ioctl(p->fd[e], PERF_EVENT_IOC_RESET, 0);
+		ioctl(p->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+	static void
+bench_perf_stop(struct bench_perf *p)
+{
+	uint32_t e;
+
+	if (!p->enabled) return;
+	for (e = 0; e < BENCH_PERF_EVENTS; e++) {
+		p->count[e] = 0;
+		if (p->fd[e] < 0) continue;
+		ioctl(p->fd[e], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(p->fd[e], &p->count[e], sizeof(uint64_t)) != sizeof(uint64_t)) p->count[e] = 0;
+	}
+}
+
+	static uint64_t
+bench_nanoseconds(void)
+{
+	uint64_t result;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	result = (uint64_t)ts.tv_nsec;
+	result += (uint64_t)ts.tv_sec * 1000000000;
+	return result;
+}
+
+	static void
+bench_zipf_init(struct bench_zipf *z, uint32_t n, double theta)
+{
+	uint32_t i;
+	double zeta2 = 0.0;
+
+	z->n = n;
+	z->theta = theta;
+	z->alpha = 1.0 / (1.0 - theta);
+	z->zetan = 0.0;
+	for (i = 1; i <= n; i++) {
+		z->zetan += 1.0 / pow((double)i, theta);
+		if (i <= 2) zeta2 = z->zetan;
+	}
+	z->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+	static uint32_t
+bench_zipf_next(struct bench_zipf *z)
+{
+	double u = drand48(), uz = u * z->zetan;
+
+	if (uz < 1.0) return 0;
+	if (uz < 1.0 + pow(0.5, z->theta)) return 1;
+	return (uint32_t)((double)z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+}
+
+	static uint32_t
+bench_key(struct bench *b)
+{
+	uint32_t rank;
+
+	switch (b->gen) {
+		case BENCH_GEN_ZIPF:
+			rank = bench_zipf_next(&b->zipf);
+			/* Scramble the rank so adjacent hot ranks spread over the key space. */
+			return (rank * (uint32_t)2654435761u) % b->space;
+		case BENCH_GEN_SEQ:
+			return b->seq++ % b->space;
+		case BENCH_GEN_UNIFORM:
+		default:
+			return (uint32_t)lrand48() % b->space;
+	}
+}
+
+	static int
+bench_lat_compare(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a,
+			 y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Emit one CSV row for a finished phase - lat is sorted in place.
+ */
+	static void
+bench_report(
+		const char *phase,
+		cfix_t *h,
+		struct bench_perf *perf,
+		uint32_t *lat,
+		uint64_t n,
+		uint64_t total)
+{
+	double fill = 100.0 * (double)cfix_keys(h) / ((double)cfix_bins(h) * (double)CFIX_BIN_SIZE);
+	uint32_t e;
+
+	qsort(lat, n, sizeof(uint32_t), bench_lat_compare);
+	printf("%s,%lu,%u,%.3f,%lu,%u,%u,%u,%.3f",
+			phase,
+			n,
+			cfix_keys(h),
+			fill,
+			total / n,
+			lat[(n - 1) / 2],
+			lat[(n - 1) * 99 / 100],
+			lat[(n - 1) * 999 / 1000],
+			(double)n * 1000.0 / (double)total);
+	if (perf->enabled) {
+		for (e = 0; e < BENCH_PERF_EVENTS; e++) {
+			printf(",%.3f", (double)perf->count[e] / (double)n);
+		}
+	}
+	printf("\n");
+}
+
+	static void
+bench_usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [options]\n", prog);
+	fprintf(stderr, "\t-n <keys>\tnumber of keys to load (default 1048576)\n");
+	fprintf(stderr, "\t-o <ops>\tnumber of operations in the mixed phase (default 1048576)\n");
+	fprintf(stderr, "\t-d <words>\tdata words per entry (default 1)\n");
+	fprintf(stderr, "\t-k <gen>\tkey generator: uniform, zipf or seq (default uniform)\n");
+	fprintf(stderr, "\t-z <theta>\tZipfian skew (default 0.99)\n");
+	fprintf(stderr, "\t-m <i:l:d>\tmixed phase insert:lookup:delete percentages (default 0:100:0)\n");
+	fprintf(stderr, "\t-s <seed>\trandom seed (default 42)\n");
+	fprintf(stderr, "\t-p\t\tcount hardware events per operation (perf_event_open)\n");
+	fprintf(stderr, "\t-h\t\tthis message\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	cfix_t *h;
+	cfix_config_t conf;
+	struct bench b;
+	struct bench_perf perf;
+	uint32_t *lat;
+	uint32_t data[CFIX_DATA_MAXSIZE];
+	uint64_t n = 1 << 20, ops = 1 << 20, k, loaded, total, t0, t1;
+	uint32_t mix_insert = 0, mix_lookup = 100, mix_delete = 0;
+	double theta = 0.99;
+	long seed = 42;
+	int opt;
+	bool count = false;
+
+	memset(&b, 0, sizeof(b));
+	b.gen = BENCH_GEN_UNIFORM;
+	memset(&perf, 0, sizeof(perf));
+
+	conf.start = CFIX_CONFIG_DEFAULT_START;
+	conf.data = 1;
+	conf.depth = CFIX_CONFIG_DEFAULT_DEPTH;
+	conf.lower = 0.05;
+	conf.upper = 0.95;
+	conf.growth = CFIX_CONFIG_DEFAULT_GROWTH;
+	conf.attempt = CFIX_CONFIG_DEFAULT_ATTEMPT;
+	conf.random = CFIX_CONFIG_DEFAULT_RANDOM;
+	conf.migrate = CFIX_CONFIG_DEFAULT_MIGRATE;
+	conf.ptwo = CFIX_CONFIG_DEFAULT_PTWO;
+	conf.indirect = CFIX_CONFIG_DEFAULT_INDIRECT;
+
+	while ((opt = getopt(argc, argv, "n:o:d:k:z:m:s:ph")) != -1) {
+		switch (opt) {
+			case 'n':
+				n = strtoul(optarg, NULL, 0);
+				break;
+			case 'o':
+				ops = strtoul(optarg, NULL, 0);
+				break;
+			case 'd':
+				conf.data = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+			case 'k':
+				if (strcmp(optarg, "uniform") == 0) b.gen = BENCH_GEN_UNIFORM;
+				else if (strcmp(optarg, "zipf") == 0) b.gen = BENCH_GEN_ZIPF;
+				else if (strcmp(optarg, "seq") == 0) b.gen = BENCH_GEN_SEQ;
+				else bench_usage(argv[0]);
+				break;
+			case 'z':
+				theta = strtod(optarg, NULL);
+				break;
+			case 'm':
+				if (sscanf(optarg, "%u:%u:%u", &mix_insert, &mix_lookup, &mix_delete) != 3 ||
+						mix_insert + mix_lookup + mix_delete != 100) bench_usage(argv[0]);
+				break;
+			case 's':
+				seed = strtol(optarg, NULL, 0);
+				break;
+			case 'p':
+				count = true;
+				break;
+			case 'h':
+			default:
+				bench_usage(argv[0]);
+		}
+	}
+
+	assert(n > 0 && ops > 0);
+	assert(conf.data < CFIX_DATA_MAXSIZE);
+
+	srand48(seed);
+
+	/* Twice the loaded keys so the mixed phase misses roughly half the time. */
+	b.space = (uint32_t)(2 * n);
+	if (b.gen == BENCH_GEN_ZIPF) bench_zipf_init(&b.zipf, b.space, theta);
+
+	lat = (uint32_t *)malloc((n > ops ? n : ops) * sizeof(uint32_t));
+	assert(lat != NULL);
+
+	if (count) bench_perf_open(&perf);
+
+	cfix_create(&h, &conf);
+
+	printf("phase,ops,keys,fill,ns_mean,ns_p50,ns_p99,ns_p999,mops");
+	if (perf.enabled) {
+		uint32_t e;
+
+		for (e = 0; e < BENCH_PERF_EVENTS; e++) printf(",%s", bench_perf_event[e].name);
+	}
+	printf("\n");
+
+	/*
+	 * Load phase - insert keys 0 .. n - 1 so every generator starts the mixed
+	 * phase from the same table; the key distribution only shapes the mixed
+	 * phase.
+	 */
+	bench_perf_start(&perf);
+	total = 0;
+	for (k = 0; k < n; k++) {
+		uint32_t key = (uint32_t)k, w;
+
+		for (w = 0; w < conf.data; w++) data[w] = ~key;
+		t0 = bench_nanoseconds();
+		cfix_insert(h, key, data);
+		t1 = bench_nanoseconds();
+		lat[k] = (uint32_t)(t1 - t0);
+		total += t1 - t0;
+	}
+	bench_perf_stop(&perf);
+	bench_report("load", h, &perf, lat, n, total);
+
+	/*
+	 * Mixed phase - operations drawn from the requested insert/lookup/delete
+	 * mix with keys from the same generator.
+	 */
+	bench_perf_start(&perf);
+	total = 0;
+	for (k = 0; k < ops; k++) {
+		uint32_t key = bench_key(&b), pick = (uint32_t)lrand48() % 100, w;
+
+		for (w = 0; w < conf.data; w++) data[w] = ~key;
+		t0 = bench_nanoseconds();
+		if (pick < mix_insert) {
+			cfix_insert(h, key, data);
+		} else if (pick < mix_insert + mix_lookup) {
+			cfix_lookup(h, key, data);
+		} else {
+			cfix_delete(h, key);
+		}
+		t1 = bench_nanoseconds();
+		lat[k] = (uint32_t)(t1 - t0);
+		total += t1 - t0;
+	}
+	bench_perf_stop(&perf);
+	bench_report("mixed", h, &perf, lat, ops, total);
+
+	/*
+	 * Drain phase - delete every key in the space, timing the hits.
+	 */
+	bench_perf_start(&perf);
+	total = 0;
+	for (k = 0, loaded = 0; k < b.space && cfix_keys(h) > 0; k++) {
+		t0 = bench_nanoseconds();
+		if (cfix_delete(h, (uint32_t)k)) {
+			t1 = bench_nanoseconds();
+			lat[loaded++] = (uint32_t)(t1 - t0);
+			total += t1 - t0;
+		}
+	}
+	bench_perf_stop(&perf);
+	if (loaded > 0) bench_report("drain", h, &perf, lat, loaded, total);
+
+	cfix_destroy(&h);
+	m2_exit();
+	free(lat);
+	return 0;
+}
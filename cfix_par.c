@@ -0,0 +1,216 @@
+/**
+ * @file cfix_par.c
+ * @brief Sharded concurrent wrapper around CFIX for multicore scaling.
+ * @author Mikael Sundstrom <micke@fabinv.com>
+ *
+ * @copyright Copyright (c) 2018 Fabulous Inventions AB - all rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "cfix_par.h"
+
+static m2_t *cfix_par_handle = NULL,
+			*cfix_par_shard_handle = NULL,
+			*cfix_par_lock_handle = NULL;
+
+static pthread_once_t cfix_par_handle_once = PTHREAD_ONCE_INIT;
+
+struct cfix_par {
+	cfix_t **shard;				/*< Array of independent CFIX instances. */
+	pthread_rwlock_t *lock;		/*< One readers-writer lock per shard. */
+	uint32_t shards;			/*< Number of shards - always a power of two. */
+	uint32_t shift;				/*< Shift producing shard index from mixed key. */
+};
+
+/*
+ * Shard selection uses a multiplicative mix of the key rather than the
+ * avalanche hashes so that shard choice and intra-shard bin placement stay
+ * uncorrelated.
+ */
+	static inline uint32_t
+cfix_par_shard_of(cfix_par_t *p, uint32_t key)
+{
+	/* shift is 32 when shards == 1 and a 32-bit shift of a 32-bit value is
+	 * undefined - mask the count and the index so every permitted shard
+	 * count is safe. */
+	return ((key * (uint32_t)2654435761u) >> (p->shift & 31)) & (p->shards - 1);
+}
+
+/*
+ * Create all m2 handles up front under pthread_once - lazy creation at
+ * first use races when several threads create sharded tables at once.
+ */
+	static void
+cfix_par_handle_init(void)
+{
+	cfix_par_handle = m2_create("cfix_par_t", sizeof(cfix_par_t));
+	assert(cfix_par_handle != NULL);
+	cfix_par_shard_handle = m2_create("cfix_par_shard", sizeof(cfix_t *));
+	assert(cfix_par_shard_handle != NULL);
+	cfix_par_lock_handle = m2_create("cfix_par_lock", sizeof(pthread_rwlock_t));
+	assert(cfix_par_lock_handle != NULL);
+}
+
+	void
+cfix_par_create(
+		cfix_par_t **p,
+		cfix_config_t *conf,
+		uint32_t shards)
+{
+	cfix_config_t shard_conf;
+	uint32_t s;
+
+	assert(p != NULL);
+	assert(shards >= 1 && shards <= CFIX_PAR_SHARDS_MAX);
+
+	pthread_once(&cfix_par_handle_once, cfix_par_handle_init);
+
+	(*p) = (cfix_par_t *)m2_reuse(cfix_par_handle, 1, true);
+
+	(*p)->shards = 1;
+	while ((*p)->shards < shards) (*p)->shards <<= 1;
+	(*p)->shift = 32;
+	for (s = (*p)->shards; s > 1; s >>= 1) --(*p)->shift;
+
+	if (conf == NULL) {
+		shard_conf.start = CFIX_CONFIG_DEFAULT_START;
+		shard_conf.data = CFIX_CONFIG_DEFAULT_DATA;
+		shard_conf.depth = CFIX_CONFIG_DEFAULT_DEPTH;
+		shard_conf.lower = CFIX_CONFIG_DEFAULT_LOWER;
+		shard_conf.upper = CFIX_CONFIG_DEFAULT_UPPER;
+		shard_conf.growth = CFIX_CONFIG_DEFAULT_GROWTH;
+		shard_conf.attempt = CFIX_CONFIG_DEFAULT_ATTEMPT;
+		shard_conf.random = CFIX_CONFIG_DEFAULT_RANDOM;
+		shard_conf.migrate = CFIX_CONFIG_DEFAULT_MIGRATE;
+		shard_conf.ptwo = CFIX_CONFIG_DEFAULT_PTWO;
+		shard_conf.indirect = CFIX_CONFIG_DEFAULT_INDIRECT;
+	} else {
+		shard_conf = (*conf);
+	}
+	shard_conf.start = shard_conf.start / (*p)->shards + 1;
+
+	(*p)->shard = (cfix_t **)m2_reuse(cfix_par_shard_handle, (*p)->shards, true);
+	(*p)->lock = (pthread_rwlock_t *)m2_reuse(cfix_par_lock_handle, (*p)->shards, false);
+
+	for (s = 0; s < (*p)->shards; s++) {
+		cfix_create(&(*p)->shard[s], &shard_conf);
+		pthread_rwlock_init(&(*p)->lock[s], NULL);
+	}
+}
+
+	void
+cfix_par_destroy(cfix_par_t **p)
+{
+	uint32_t s;
+
+	for (s = 0; s < (*p)->shards; s++) {
+		cfix_destroy(&(*p)->shard[s]);
+		pthread_rwlock_destroy(&(*p)->lock[s]);
+	}
+	m2_recycle(cfix_par_lock_handle, (*p)->lock, (*p)->shards);
+	m2_recycle(cfix_par_shard_handle, (*p)->shard, (*p)->shards);
+	m2_recycle(cfix_par_handle, (*p), 1);
+	(*p) = NULL;
+}
+
+	bool
+cfix_par_insert(cfix_par_t *p, uint32_t key, uint32_t *data)
+{
+	uint32_t s = cfix_par_shard_of(p, key);
+	bool result;
+
+	pthread_rwlock_wrlock(&p->lock[s]);
+	result = cfix_insert(p->shard[s], key, data);
+	pthread_rwlock_unlock(&p->lock[s]);
+	return result;
+}
+
+	bool
+cfix_par_delete(cfix_par_t *p, uint32_t key)
+{
+	uint32_t s = cfix_par_shard_of(p, key);
+	bool result;
+
+	pthread_rwlock_wrlock(&p->lock[s]);
+	result = cfix_delete(p->shard[s], key);
+	pthread_rwlock_unlock(&p->lock[s]);
+	return result;
+}
+
+	bool
+cfix_par_lookup(cfix_par_t *p, uint32_t key, uint32_t *data)
+{
+	uint32_t s = cfix_par_shard_of(p, key);
+	bool result;
+
+	pthread_rwlock_rdlock(&p->lock[s]);
+	result = cfix_lookup(p->shard[s], key, data);
+	pthread_rwlock_unlock(&p->lock[s]);
+	return result;
+}
+
+	bool
+cfix_par_update(cfix_par_t *p, uint32_t key, uint32_t *data)
+{
+	uint32_t s = cfix_par_shard_of(p, key);
+	bool result;
+
+	pthread_rwlock_wrlock(&p->lock[s]);
+	result = cfix_update(p->shard[s], key, data);
+	pthread_rwlock_unlock(&p->lock[s]);
+	return result;
+}
+
+	uint32_t
+cfix_par_keys(cfix_par_t *p)
+{
+	uint32_t s, result = 0;
+
+	for (s = 0; s < p->shards; s++) {
+		pthread_rwlock_rdlock(&p->lock[s]);
+		result += cfix_keys(p->shard[s]);
+		pthread_rwlock_unlock(&p->lock[s]);
+	}
+	return result;
+}
+
+	uint32_t
+cfix_par_shards(cfix_par_t *p)
+{
+	return p->shards;
+}
+
+	void
+cfix_par_apply(
+		cfix_par_t *p,
+		void(*fun)(uint32_t, uint32_t *, void *),
+		void *aux)
+{
+	uint32_t s;
+
+	for (s = 0; s < p->shards; s++) {
+		pthread_rwlock_rdlock(&p->lock[s]);
+		cfix_apply(p->shard[s], fun, aux);
+		pthread_rwlock_unlock(&p->lock[s]);
+	}
+}
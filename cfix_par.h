@@ -0,0 +1,132 @@
+/**
+ * @file cfix_par.h
+ * @brief Sharded concurrent wrapper around CFIX for multicore scaling.
+ * @author Mikael Sundstrom <micke@fabinv.com>
+ *
+ * @copyright Copyright (c) 2018 Fabulous Inventions AB - all rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef CFIX_PAR
+#define CFIX_PAR
+
+#include "cfix.h"
+
+/** @brief Maximum number of shards supported. */
+#define CFIX_PAR_SHARDS_MAX 256
+
+/** @brief CFIX_PAR abstract data type. */
+struct cfix_par;
+typedef struct cfix_par cfix_par_t;
+
+/**
+ * @brief Create new sharded hash table instance.
+ *
+ * Keys are distributed over shards by the high bits of the full avalanche
+ * hash, each shard being an independent cfix_t protected by its own
+ * readers-writer lock, so updates to different shards proceed in parallel.
+ *
+ * @param p Location to store new CFIX_PAR instance.
+ * @param conf Per-shard configuration or NULL for default configuration - the start value is divided evenly over the shards.
+ * @param shards Requested number of shards - rounded up to the next power of two, at most CFIX_PAR_SHARDS_MAX.
+ */
+void cfix_par_create(cfix_par_t **p, cfix_config_t *conf, uint32_t shards);
+
+/**
+ * @brief Destroy existing CFIX_PAR instance.
+ *
+ * @param p Location of CFIX_PAR instance to destroy.
+ */
+void cfix_par_destroy(cfix_par_t **p);
+
+/**
+ * @brief Insert (key, data) pair in CFIX_PAR instance.
+ *
+ * @param p CFIX_PAR instance to perform insertion in.
+ * @param key Key to insert.
+ * @param data Location of data to insert.
+ *
+ * @return Boolean true on success and false otherwise (e.g. key present).
+ */
+bool cfix_par_insert(cfix_par_t *p, uint32_t key, uint32_t *data);
+
+/**
+ * @brief Delete key and associated data from CFIX_PAR instance.
+ *
+ * @param p CFIX_PAR instance to perform deletion from.
+ * @param key Key to delete.
+ *
+ * @return Boolean true on success and false otherwise (e.g. key missing).
+ */
+bool cfix_par_delete(cfix_par_t *p, uint32_t key);
+
+/**
+ * @brief Lookup data associated with key in CFIX_PAR instance.
+ *
+ * @param p CFIX_PAR instance to perform lookup in.
+ * @param key Key to lookup.
+ * @param data Location where looked up data is stored on successful lookup.
+ *
+ * @return Boolean true on success and false otherwise (e.g. key missing).
+ */
+bool cfix_par_lookup(cfix_par_t *p, uint32_t key, uint32_t *data);
+
+/**
+ * @brief Update data associated with key in CFIX_PAR instance.
+ *
+ * @param p CFIX_PAR instance to perform update in.
+ * @param key Key associated with data.
+ * @param data Data to associate with key.
+ *
+ * @return Boolean true on success and false otherwise (e.g. key missing).
+ */
+bool cfix_par_update(cfix_par_t *p, uint32_t key, uint32_t *data);
+
+/**
+ * @brief Return current number of keys summed over all shards.
+ *
+ * @param p CFIX_PAR instance.
+ *
+ * @return Current number of keys in the table.
+ */
+uint32_t cfix_par_keys(cfix_par_t *p);
+
+/**
+ * @brief Return current number of shards.
+ *
+ * @param p CFIX_PAR instance.
+ *
+ * @return Current number of shards.
+ */
+uint32_t cfix_par_shards(cfix_par_t *p);
+
+/**
+ * @brief Apply call-back function on all (key, data)-pairs in CFIX_PAR instance, shard by shard.
+ *
+ * Each shard is read-locked for the duration of its scan, so writers to
+ * other shards are not blocked and the call-back sees a consistent view of
+ * one shard at a time.
+ *
+ * @param p CFIX_PAR instance.
+ * @param fun Call-back function where the arguments are key, data and auxiliary pointer in that order.
+ * @param aux Auxiliary pointer passed to call-back function.
+ */
+void cfix_par_apply(cfix_par_t *p, void(*fun)(uint32_t, uint32_t *, void *), void *aux);
+
+#endif /* CFIX_PAR */
@@ -7900,3 +7900,35 @@ hash_primes_index_to_number(uint32_t index)
 		return (uint64_t)hash_primes_number[synth] * (uint64_t)hash_primes_number[synth + 1];
 	}
 }
+
+/**
+ * @brief Produce the magic reciprocal constant for divisor number.
+ *
+ * @param number Divisor, typically obtained from hash_primes_index_to_number - must be larger than 1 and fit in 32 bits.
+ *
+ * @return Magic constant ceil(2^64 / number) for use with hash_primes_mod.
+ */
+	static inline uint64_t
+hash_primes_magic(uint64_t number)
+{
+	return UINT64_MAX / number + 1;
+}
+
+/**
+ * @brief Compute x modulo number without a hardware divide.
+ *
+ * Granlund-Montgomery / Lemire style reciprocal multiplication - exact for
+ * all 32-bit x and 32-bit number, two multiplies instead of a 20-40 cycle
+ * divide.
+ *
+ * @param magic Magic constant produced by hash_primes_magic(number).
+ * @param number Divisor.
+ * @param x Dividend.
+ *
+ * @return x % number.
+ */
+	static inline uint32_t
+hash_primes_mod(uint64_t magic, uint32_t number, uint32_t x)
+{
+	return (uint32_t)((unsigned __int128)(magic * x) * number >> 64);
+}
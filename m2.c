@@ -28,6 +28,10 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include "m2.h"
 
@@ -35,12 +39,46 @@
 
 #define M2_REPORT_BUFSIZE 65536
 
-//#define M2_RECYCLED_BLOCKSIZE 256
-#define M2_RECYCLED_BLOCKSIZE 0
+/*
+ * Enable to clear recycled blocks before they are cached or freed (debugging
+ * aid - catches use after recycle at the cost of touching every byte).
+ */
+//#define M2_CLEAR_ON_RECYCLE
+
+/*
+ * Number of per-handle freelist size classes (one per power of two) and
+ * maximum number of cached blocks per class.
+ */
+#define M2_FREELIST_CLASSES 64
+#define M2_FREELIST_DEPTH 8
+
+/*
+ * Number of handles tracked by each per-thread magazine cache and maximum
+ * number of cached blocks per size class and thread.
+ */
+#define M2_TCACHE_HANDLES 16
+#define M2_TCACHE_DEPTH 4
+
+/*
+ * Huge page size and minimum allocation size for huge page backing of
+ * handles with huge page backing enabled (see m2_huge).
+ */
+#define M2_HUGE_PAGESIZE ((size_t)1 << 21)
+#define M2_HUGE_THRESHOLD M2_HUGE_PAGESIZE
+
+/*
+ * Kernel memory policy constants (mirrored here to avoid a libnuma
+ * dependency) and nodemask capacity for mbind/get_mempolicy.
+ */
+#define M2_MPOL_BIND 2
+#define M2_MPOL_INTERLEAVE 3
+#define M2_MPOL_F_MEMS_ALLOWED 4
+#define M2_NUMA_MAXNODE 1024
 
 #define M2_REPORT_INTERVAL 0
 
 #define M2_LINK(p) (*((void **)p))
+#define M2_SIZE(p) (((size_t *)p)[1])
 
 struct m2 {
 	m2_t *link;
@@ -50,14 +88,37 @@ struct m2 {
 	uint64_t newusage;
 	uint64_t oldusage;
 	uint64_t maxusage;
+	bool huge;
+	m2_numa_t numa;
+	int node;
+	pthread_mutex_t mutex;	/*< Protects the shared freelist below. */
+	void *freelist[M2_FREELIST_CLASSES];
+	uint32_t freedepth[M2_FREELIST_CLASSES];
 	char id[M2_IDSIZE];
 };
 
-static m2_t m2_total = {NULL, 0, 0, 0, 0, 0, 0, "total"};
+/** @brief Per-thread magazine cache slot for one handle. */
+struct m2_tslot {
+	m2_t *handle;
+	void *freelist[M2_FREELIST_CLASSES];
+	uint32_t freedepth[M2_FREELIST_CLASSES];
+};
+
+/** @brief Per-thread magazine cache - consulted lock-free before the shared freelists. */
+struct m2_tcache {
+	struct m2_tslot slot[M2_TCACHE_HANDLES];
+};
+
+static m2_t m2_total = {NULL, 0, 0, 0, 0, 0, 0, false, M2_NUMA_DEFAULT, 0,
+		PTHREAD_MUTEX_INITIALIZER, {NULL}, {0}, "total"};
 
 static m2_t *m2_anchor = NULL;
 
-static void *m2_recycled_block[M2_RECYCLED_BLOCKSIZE];
+/* Protects the anchor chain, initialization and handle creation/destruction. */
+static pthread_mutex_t m2_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t m2_tcache_key;
+static __thread struct m2_tcache *m2_tcache = NULL;
 
 static bool m2_initialized = false;
 static void (*m2_error_fun)(char *) = NULL;
@@ -83,22 +144,201 @@ m2_abort(char *msg)
 	exit(1);
 }
 
+/*
+ * Map a block size in bytes to its freelist size class (floor of log2).
+ */
+static int
+m2_class(size_t bytes)
+{
+	return 63 - __builtin_clzll((uint64_t)bytes);
+}
+
+/*
+ * Determine whether a block of given size is mmap backed (required for huge
+ * page backing and NUMA policies, both of which act on whole mappings).
+ */
+static bool
+m2_mapblock(m2_t *m, size_t bytes)
+{
+	return (m->huge || m->numa != M2_NUMA_DEFAULT) && bytes >= M2_HUGE_THRESHOLD;
+}
+
+/*
+ * Apply the NUMA policy of a handle to a mapping. Best effort - the mapping
+ * works, if sub-optimally placed, when mbind is unsupported or fails.
+ */
+static void
+m2_numa_apply(m2_t *m, void *p, size_t length)
+{
+#if defined(__NR_mbind) && defined(__NR_get_mempolicy)
+	unsigned long nodemask[M2_NUMA_MAXNODE / (8 * sizeof(unsigned long))];
+	int mode;
+
+	if (m->numa == M2_NUMA_DEFAULT) return;
+
+	memset(nodemask, 0, sizeof(nodemask));
+	if (m->numa == M2_NUMA_BIND) {
+		mode = M2_MPOL_BIND;
+		nodemask[m->node / (8 * sizeof(unsigned long))] |=
+				1ul << (m->node % (8 * sizeof(unsigned long)));
+	} else {
+		mode = M2_MPOL_INTERLEAVE;
+		if (syscall(__NR_get_mempolicy, NULL, nodemask, M2_NUMA_MAXNODE,
+				NULL, M2_MPOL_F_MEMS_ALLOWED) != 0) return;
+	}
+	(void)syscall(__NR_mbind, p, length, mode, nodemask, M2_NUMA_MAXNODE, 0);
+#endif
+}
+
+/*
+ * Allocate mmap backed memory, preferring explicit huge pages and falling
+ * back to transparent huge pages and finally ordinary pages when huge page
+ * backing is enabled, and applying the NUMA policy of the handle.
+ */
+static void *
+m2_mapalloc(m2_t *m, size_t bytes)
+{
+	size_t length = (bytes + M2_HUGE_PAGESIZE - 1) & ~(M2_HUGE_PAGESIZE - 1);
+	void *result = NULL;
+
+#ifdef MAP_HUGETLB
+	if (m->huge) {
+		result = mmap(NULL, length, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (result == MAP_FAILED) result = NULL;
+	}
+#endif
+	if (result == NULL) {
+		result = mmap(NULL, length, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (result == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+		if (m->huge) madvise(result, length, MADV_HUGEPAGE);
+#endif
+	}
+	m2_numa_apply(m, result, length);
+	return result;
+}
+
+/*
+ * Release a block, unmapping mmap backed blocks and freeing the rest.
+ */
+static void
+m2_free(m2_t *m, void *p, size_t bytes)
+{
+	if (m2_mapblock(m, bytes)) {
+		munmap(p, (bytes + M2_HUGE_PAGESIZE - 1) & ~(M2_HUGE_PAGESIZE - 1));
+	} else {
+		free(p);
+	}
+}
+
+/*
+ * Atomically account an allocation against the usage counters of a handle.
+ */
+static void
+m2_account_reuse(m2_t *m, size_t bytes)
+{
+	uint64_t usage, max;
+
+	usage = __atomic_add_fetch(&m->reused, bytes, __ATOMIC_RELAXED) -
+			__atomic_load_n(&m->recycled, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&m->maxusage, __ATOMIC_RELAXED);
+	while (usage > max &&
+			!__atomic_compare_exchange_n(&m->maxusage, &max, usage,
+				false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*
+ * Return cached blocks of an exiting thread to the system (the blocks are
+ * already accounted as recycled, only the memory itself needs releasing).
+ */
+static void
+m2_tcache_destructor(void *arg)
+{
+	struct m2_tcache *cache = (struct m2_tcache *)arg;
+	int i, c;
+
+	for (i = 0; i < M2_TCACHE_HANDLES; i++) {
+		struct m2_tslot *slot = &cache->slot[i];
+
+		if (slot->handle == NULL) continue;
+		for (c = 0; c < M2_FREELIST_CLASSES; c++) {
+			while (slot->freelist[c] != NULL) {
+				void *vic = slot->freelist[c];
+
+				slot->freelist[c] = M2_LINK(vic);
+				m2_free(slot->handle, vic, M2_SIZE(vic));
+			}
+		}
+	}
+	free(cache);
+}
+
+/*
+ * Look up, and optionally claim, the magazine cache slot of the calling
+ * thread for a handle. Returns NULL when no slot is available.
+ */
+static struct m2_tslot *
+m2_tslot(m2_t *m, bool claim)
+{
+	struct m2_tcache *cache = m2_tcache;
+	int i;
+
+	if (cache == NULL) {
+		if (!claim) return NULL;
+		cache = (struct m2_tcache *)calloc(1, sizeof(struct m2_tcache));
+		if (cache == NULL) return NULL;
+		m2_tcache = cache;
+		pthread_setspecific(m2_tcache_key, cache);
+	}
+	for (i = 0; i < M2_TCACHE_HANDLES; i++) {
+		if (cache->slot[i].handle == m) return &cache->slot[i];
+		if (cache->slot[i].handle == NULL) {
+			if (!claim) return NULL;
+			cache->slot[i].handle = m;
+			return &cache->slot[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Free all blocks cached on the freelists of a handle.
+ */
+static void
+m2_drain(m2_t *handle)
+{
+	int c;
+
+	for (c = 0; c < M2_FREELIST_CLASSES; c++) {
+		while (handle->freelist[c] != NULL) {
+			void *vic = handle->freelist[c];
+
+			handle->freelist[c] = M2_LINK(vic);
+			m2_free(handle, vic, M2_SIZE(vic));
+		}
+		handle->freedepth[c] = 0;
+	}
+}
+
 void
 m2_init(void (*error)(char *))
 {
-		int i;
+		pthread_mutex_lock(&m2_mutex);
 
-		for (i = 0; i < M2_RECYCLED_BLOCKSIZE; i++) {
-			m2_recycled_block[i] = (void *)NULL;
+		if (!m2_initialized) {
+			pthread_key_create(&m2_tcache_key, m2_tcache_destructor);
+			m2_initialized = true;
 		}
 
-		m2_initialized = true;
-	
 		if (error == NULL) {
 			m2_error_fun = m2_default_error_fun;
 		} else {
 			m2_error_fun = error;
 		}
+
+		pthread_mutex_unlock(&m2_mutex);
 }
 
 void
@@ -106,9 +346,12 @@ m2_exit(void)
 {
 	m2_t *cur;
 
+	pthread_mutex_lock(&m2_mutex);
+
 	for (cur = m2_anchor; cur != NULL; cur = cur->link) {
 		if (cur->reused != cur->recycled) {
-			m2_error("\n\nFATAL ERROR in m2_exit - all items must be recycled before exiting!\n");  
+			pthread_mutex_unlock(&m2_mutex);
+			m2_error("\n\nFATAL ERROR in m2_exit - all items must be recycled before exiting!\n");
 			m2_abort(m2_report(m2_report_buf, M2_REPORT_BUFSIZE));
 		}
 	}
@@ -116,9 +359,13 @@ m2_exit(void)
 		m2_t *vic = cur;
 
 		cur = cur->link;
+		m2_drain(vic);
+		pthread_mutex_destroy(&vic->mutex);
 		free(vic);
 	}
 	m2_anchor = NULL;
+
+	pthread_mutex_unlock(&m2_mutex);
 }
 
 	m2_t *
@@ -139,11 +386,14 @@ m2_create(const char *id, size_t size)
 		m2_abort(buf);
 	}
 
+	pthread_mutex_lock(&m2_mutex);
+
 	for (current = m2_anchor;
 			current != NULL;
 			current = current->link)
 	{
 		if (!strncmp(id, current->id, M2_IDSIZE)) {
+			pthread_mutex_unlock(&m2_mutex);
 			sprintf(buf, "FATAL ERROR in m2_create - identifier %s is already in use!", id);
 			m2_abort(buf);
 		}
@@ -152,6 +402,7 @@ m2_create(const char *id, size_t size)
 	result = (m2_t *)malloc(sizeof(m2_t));
 
 	if (result == NULL) {
+		pthread_mutex_unlock(&m2_mutex);
 		sprintf(buf, "FATAL ERROR in m2_create - failed to create \"%s\" handle!", id);
 		m2_abort(buf);
 	}
@@ -164,9 +415,17 @@ m2_create(const char *id, size_t size)
 	result->newusage = 0;
 	result->oldusage = 0;
 	result->maxusage = 0;
+	result->huge = false;
+	result->numa = M2_NUMA_DEFAULT;
+	result->node = 0;
+	pthread_mutex_init(&result->mutex, NULL);
+	memset(result->freelist, 0, sizeof(result->freelist));
+	memset(result->freedepth, 0, sizeof(result->freedepth));
 	result->link = m2_anchor;
 	m2_anchor = result;
 
+	pthread_mutex_unlock(&m2_mutex);
+
 	return result;
 }
 
@@ -174,11 +433,15 @@ m2_create(const char *id, size_t size)
 m2_destroy(m2_t *handle)
 {
 	char buf[M2_ERROR_BUFSIZE];
+	struct m2_tslot *slot;
 	m2_t **curr;
 
+	pthread_mutex_lock(&m2_mutex);
+
 	curr = &m2_anchor;
 	for (;;) {
 		if ((*curr) == NULL) {
+			pthread_mutex_unlock(&m2_mutex);
 			sprintf(buf,
 					"FATAL ERROR in m2_destroy - handle %s "
 					"missing from anchor chain!", handle->id);
@@ -190,9 +453,57 @@ m2_destroy(m2_t *handle)
 		}
 		curr = &(*curr)->link;
 	}
+
+	pthread_mutex_unlock(&m2_mutex);
+
+	/*
+	 * Release the magazine cache slot of the calling thread (blocks cached
+	 * by other threads are the responsibility of the caller, who must not
+	 * destroy a handle while it is in use elsewhere).
+	 */
+	slot = m2_tslot(handle, false);
+	if (slot != NULL) {
+		int c;
+
+		for (c = 0; c < M2_FREELIST_CLASSES; c++) {
+			while (slot->freelist[c] != NULL) {
+				void *vic = slot->freelist[c];
+
+				slot->freelist[c] = M2_LINK(vic);
+				m2_free(handle, vic, M2_SIZE(vic));
+			}
+			slot->freedepth[c] = 0;
+		}
+		slot->handle = NULL;
+	}
+
+	m2_drain(handle);
+	pthread_mutex_destroy(&handle->mutex);
 	free(handle);
 }
 
+	void
+m2_huge(m2_t *handle, bool enable)
+{
+	if (handle->reused != 0) {
+		m2_abort("FATAL ERROR in m2_huge - huge page backing must be configured before first use of handle!");
+	}
+	handle->huge = enable;
+}
+
+	void
+m2_numa(m2_t *handle, m2_numa_t policy, int node)
+{
+	if (handle->reused != 0) {
+		m2_abort("FATAL ERROR in m2_numa - NUMA policy must be configured before first use of handle!");
+	}
+	if (policy == M2_NUMA_BIND && (node < 0 || node >= M2_NUMA_MAXNODE)) {
+		m2_abort("FATAL ERROR in m2_numa - node out of range for bind policy!");
+	}
+	handle->numa = policy;
+	handle->node = node;
+}
+
 #ifdef M2_DEBUG
 	char *
 m2_report_debug(char *file, int line, char *buf, size_t size)
@@ -212,6 +523,8 @@ m2_report(char *buf, size_t size)
 	offset += delta;						\
 }
 
+	pthread_mutex_lock(&m2_mutex);
+
 	delta = sprintf(local,
 			"----------------------------------------"
 			"----------------------------------------"
@@ -280,9 +593,13 @@ m2_report(char *buf, size_t size)
 			"-----------------------------------\n");
 	M2_REPORT_COMMIT();
 
+	pthread_mutex_unlock(&m2_mutex);
+
 	return buf;
 
 bail:
+	pthread_mutex_unlock(&m2_mutex);
+
 #ifdef M2_DEBUG
 	sprintf(local,
 			"ERROR in m2_report, called from file \"%s\" line %d - "
@@ -307,7 +624,6 @@ m2_reuse(m2_t *m, size_t n, bool z)
 	char buf[M2_ERROR_BUFSIZE];
 #endif
 	void *result;
-	uint64_t usage;
 	size_t bytes;
 
 	if (m == NULL) {
@@ -334,30 +650,55 @@ m2_reuse(m2_t *m, size_t n, bool z)
 
 	bytes = n * m->size;
 
-#ifdef M2_RECYCLE
-	if (
-			sizeof(void *) <= bytes &&
-			bytes <= M2_RECYCLED_BLOCKSIZE &&
-			m2_recycled_block[bytes - 1] != NULL)
-	{
-		/* Re-use recycled memory. */
-		result = m2_recycled_block[bytes - 1];
-		m2_recycled_block[bytes - 1] = M2_LINK(result);
-		goto reused_recycled;
+	if (bytes >= 2 * sizeof(void *)) {
+		struct m2_tslot *slot = m2_tslot(m, false);
+		int c = m2_class(bytes);
+		void **prev;
+
+		if (slot != NULL) {
+			/* Lock-free: re-use from the magazine of the calling thread. */
+			for (prev = &slot->freelist[c];
+					(*prev) != NULL;
+					prev = (void **)&M2_LINK(*prev))
+			{
+				if (M2_SIZE(*prev) == bytes) {
+					result = (*prev);
+					(*prev) = M2_LINK(result);
+					slot->freedepth[c]--;
+					goto reused_recycled;
+				}
+			}
+		}
+
+		/* Re-use a shared cached block of exactly matching size if available. */
+		pthread_mutex_lock(&m->mutex);
+		for (prev = &m->freelist[c];
+				(*prev) != NULL;
+				prev = (void **)&M2_LINK(*prev))
+		{
+			if (M2_SIZE(*prev) == bytes) {
+				result = (*prev);
+				(*prev) = M2_LINK(result);
+				m->freedepth[c]--;
+				pthread_mutex_unlock(&m->mutex);
+				goto reused_recycled;
+			}
+		}
+		pthread_mutex_unlock(&m->mutex);
 	}
-#endif
-	if ((bytes % M2_ALIGNMENT) > 0) {
+	if (m2_mapblock(m, bytes)) {
+		/* Mmap backed allocation (huge pages and/or NUMA policy). */
+		result = m2_mapalloc(m, bytes);
+	} else if ((bytes % M2_ALIGNMENT) > 0) {
 		/* Non-aligned allocation. */
 		result = malloc(bytes);
 	} else {
 		/* Aligned allocation. */
 		int error = posix_memalign(&result, M2_ALIGNMENT, bytes);
-		
+
 		if (error) result = NULL;
 	}
-#ifdef M2_RECYCLE
 reused_recycled:
-#endif
 
 	if (result == NULL) {
 #ifdef M2_DEBUG
@@ -370,21 +711,8 @@ reused_recycled:
 #endif
 	}
 
-	m->reused += bytes;
-
-	usage = m->reused - m->recycled;
-
-	if (usage > m->maxusage) {
-		m->maxusage = usage;
-	}
-
-	m2_total.reused += bytes;
-
-	usage = m2_total.reused - m2_total.recycled;
-
-	if (usage > m2_total.maxusage) {
-		m2_total.maxusage = usage;
-	}
+	m2_account_reuse(m, bytes);
+	m2_account_reuse(&m2_total, bytes);
 
 	if (z) memset(result, 0, bytes);
 
@@ -417,9 +745,35 @@ m2_recycle(m2_t *m, void *p, size_t n)
 
 	bytes = n * m->size;
 
+#ifdef M2_CLEAR_ON_RECYCLE
 	memset(p, 0, bytes);
-	free(p);
-	m->recycled += bytes;
-	m2_total.recycled += bytes;
+#endif
+	if (bytes >= 2 * sizeof(void *)) {
+		struct m2_tslot *slot = m2_tslot(m, true);
+		int c = m2_class(bytes);
+
+		if (slot != NULL && slot->freedepth[c] < M2_TCACHE_DEPTH) {
+			/* Lock-free: cache block on the magazine of the calling thread. */
+			M2_LINK(p) = slot->freelist[c];
+			M2_SIZE(p) = bytes;
+			slot->freelist[c] = p;
+			slot->freedepth[c]++;
+			p = NULL;
+		} else {
+			pthread_mutex_lock(&m->mutex);
+			if (m->freedepth[c] < M2_FREELIST_DEPTH) {
+				/* Cache block on the shared freelist instead of freeing it. */
+				M2_LINK(p) = m->freelist[c];
+				M2_SIZE(p) = bytes;
+				m->freelist[c] = p;
+				m->freedepth[c]++;
+				p = NULL;
+			}
+			pthread_mutex_unlock(&m->mutex);
+		}
+	}
+	if (p != NULL) m2_free(m, p, bytes);
+	__atomic_fetch_add(&m->recycled, bytes, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&m2_total.recycled, bytes, __ATOMIC_RELAXED);
 }
 
@@ -42,6 +42,13 @@
 struct m2;
 typedef struct m2 m2_t;
 
+/** @brief NUMA allocation policy for a memory management handle. */
+typedef enum {
+	M2_NUMA_DEFAULT = 0,	/*< First-touch placement (kernel default). */
+	M2_NUMA_BIND,			/*< Allocate on one given node. */
+	M2_NUMA_INTERLEAVE		/*< Interleave pages over all allowed nodes. */
+} m2_numa_t;
+
 /**
  * @brief Initialize memory manager.
  *
@@ -71,6 +78,34 @@ m2_t *m2_create(const char *id, size_t size);
  */
 void m2_destroy(m2_t *handle);
 
+/**
+ * @brief Enable or disable huge page backing for a handle.
+ *
+ * Large allocations through the handle are backed by 2M huge pages
+ * (explicit huge pages when available, transparent huge pages otherwise,
+ * with transparent fallback to ordinary pages). Must be called before the
+ * first allocation through the handle.
+ *
+ * @param handle Memory management handle.
+ * @param enable Boolean true enables huge page backing.
+ */
+void m2_huge(m2_t *handle, bool enable);
+
+/**
+ * @brief Set the NUMA allocation policy for a handle.
+ *
+ * Large allocations through the handle are placed according to the policy:
+ * bind for per-node sharded structures, interleave for shared read-mostly
+ * structures accessed from all sockets. Best effort - placement silently
+ * reverts to first-touch on kernels without mbind support. Must be called
+ * before the first allocation through the handle.
+ *
+ * @param handle Memory management handle.
+ * @param policy NUMA allocation policy.
+ * @param node Target node for M2_NUMA_BIND (ignored otherwise).
+ */
+void m2_numa(m2_t *handle, m2_numa_t policy, int node);
+
 /**
  * @brief Print memory management report to output stream.
  *